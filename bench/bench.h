@@ -0,0 +1,21 @@
+#ifndef MU_BENCH_H
+#define MU_BENCH_H
+
+/* Shared by the programs in bench/.  Each one is linked against the
+   shell's objects minus main.o, so the globals main.c defines are
+   defined here instead.  */
+
+#include <time.h>
+
+#include "init.h"
+
+int mu_last_status;
+int debug_substitution;
+
+static inline double bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif
@@ -0,0 +1,245 @@
+/* Word expansion: the single-pass engine against the chain it replaced,
+   where tokenize() ran process_quotes() and then expand_tilde() on every
+   word, and process_quotes() called expand_variables() on each double-
+   quoted part and again on its whole result.  The old functions are
+   kept here, as they were, only to be measured.  */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "expand.h"
+
+static char *old_expand_tilde(const char *word) {
+  if (word[0] != '~')
+    return strdup(word);
+
+  char *home = getenv("HOME");
+  if (!home)
+    return strdup(word);
+
+  if (word[1] == '\0' || word[1] == '/') {
+    size_t home_len = strlen(home);
+    size_t word_len = strlen(word);
+    char *result = malloc(home_len + word_len);
+    strcpy(result, home);
+    if (word[1] == '/')
+      strcat(result, word + 1);
+    return result;
+  }
+  return strdup(word);
+}
+
+static char *old_expand_variables(const char *input) {
+  size_t len = strlen(input);
+  size_t capacity = len * 2;
+  char *result = malloc(capacity);
+  size_t out_pos = 0;
+  size_t i = 0;
+
+  while (i < len) {
+    if (input[i] == '$' && i + 1 < len) {
+      i++;
+      char *var_name = NULL;
+      char *var_value = NULL;
+
+      if (input[i] == '{') {
+        i++;
+        size_t start = i;
+        while (i < len && input[i] != '}')
+          i++;
+        if (i < len && input[i] == '}') {
+          var_name = strndup(input + start, i - start);
+          i++;
+        }
+      } else if (input[i] == '$') {
+        var_value = malloc(20);
+        snprintf(var_value, 20, "%d", getpid());
+        i++;
+      } else if (input[i] == '?') {
+        var_value = malloc(20);
+        snprintf(var_value, 20, "%d", mu_last_status);
+        i++;
+      } else if (isalnum((unsigned char)input[i]) || input[i] == '_') {
+        size_t start = i;
+        while (i < len && (isalnum((unsigned char)input[i]) || input[i] == '_'))
+          i++;
+        var_name = strndup(input + start, i - start);
+      } else {
+        result[out_pos++] = '$';
+        continue;
+      }
+
+      if (var_name && !var_value) {
+        char *env_value = getenv(var_name);
+        if (env_value)
+          var_value = strdup(env_value);
+        free(var_name);
+      }
+
+      if (var_value) {
+        size_t val_len = strlen(var_value);
+        while (out_pos + val_len >= capacity) {
+          capacity *= 2;
+          result = realloc(result, capacity);
+        }
+        strcpy(result + out_pos, var_value);
+        out_pos += val_len;
+        free(var_value);
+      }
+    } else {
+      if (out_pos + 1 >= capacity) {
+        capacity *= 2;
+        result = realloc(result, capacity);
+      }
+      result[out_pos++] = input[i++];
+    }
+  }
+
+  result[out_pos] = '\0';
+  return result;
+}
+
+static char *old_process_quotes(const char *word) {
+  size_t len = strlen(word);
+  char *result = malloc(len * 4 + 1);
+  size_t out_pos = 0;
+  size_t i = 0;
+
+  if (len >= 2 && word[0] == '\'' && word[len - 1] == '\'') {
+    for (i = 1; i < len - 1; i++)
+      result[out_pos++] = word[i];
+    result[out_pos] = '\0';
+    return result;
+  }
+
+  while (i < len) {
+    if (word[i] == '\'') {
+      i++;
+      while (i < len && word[i] != '\'')
+        result[out_pos++] = word[i++];
+      if (i < len)
+        i++;
+    } else if (word[i] == '"') {
+      i++;
+      char *temp = malloc(len * 2);
+      size_t temp_pos = 0;
+
+      while (i < len && word[i] != '"') {
+        if (word[i] == '\\' && i + 1 < len) {
+          char next = word[i + 1];
+          if (next == '"' || next == '\\' || next == '$' || next == '`' ||
+              next == '\n') {
+            temp[temp_pos++] = next;
+            i += 2;
+          } else {
+            temp[temp_pos++] = word[i++];
+          }
+        } else {
+          temp[temp_pos++] = word[i++];
+        }
+      }
+      temp[temp_pos] = '\0';
+
+      char *expanded = old_expand_variables(temp);
+      size_t exp_len = strlen(expanded);
+      while (out_pos + exp_len >= len * 4) {
+        len *= 2;
+        result = realloc(result, len * 4 + 1);
+      }
+      strcpy(result + out_pos, expanded);
+      out_pos += exp_len;
+      free(expanded);
+      free(temp);
+
+      if (i < len)
+        i++;
+    } else if (word[i] == '\\' && i + 1 < len) {
+      result[out_pos++] = word[i + 1];
+      i += 2;
+    } else {
+      result[out_pos++] = word[i++];
+    }
+  }
+
+  result[out_pos] = '\0';
+  char *final_result = old_expand_variables(result);
+  free(result);
+  return final_result;
+}
+
+// Plain, quoted, variable and tilde words, as a command line mixes them
+static const char *words[] = {
+    "ls",
+    "--color=auto",
+    "/usr/local/share/doc",
+    "'single quoted text'",
+    "\"double $HOME quoted\"",
+    "$HOME/bin",
+    "${USER}_backup",
+    "~/projects/mush",
+    "~",
+    "plain\\ escaped",
+    "\"$BENCH_LONG\"",
+    "mixed'quotes'\"and $USER\"",
+    "$?",
+    "some-file-name.tar.gz",
+};
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+
+int main(int argc, char **argv) {
+  long rounds = argc > 1 ? atol(argv[1]) : 200000;
+
+  setenv("HOME", "/home/bench", 1);
+  setenv("USER", "bench", 1);
+  setenv("BENCH_LONG", "a value that is somewhat longer than the others", 1);
+
+  // The same output from both, before timing either
+  StrBuf buf;
+  strbuf_init(&buf);
+  for (size_t w = 0; w < NWORDS; w++) {
+    char *q = old_process_quotes(words[w]);
+    char *old = old_expand_tilde(q);
+    strbuf_reset(&buf);
+    expand_word_into(words[w], strlen(words[w]), &buf);
+    if (strcmp(old, buf.data) != 0) {
+      fprintf(stderr, "expand: %s: old '%s', new '%s'\n", words[w], old,
+              buf.data);
+      return 1;
+    }
+    free(q);
+    free(old);
+  }
+
+  double t = bench_now();
+  for (long r = 0; r < rounds; r++) {
+    for (size_t w = 0; w < NWORDS; w++) {
+      char *q = old_process_quotes(words[w]);
+      char *e = old_expand_tilde(q);
+      free(q);
+      free(e);
+    }
+  }
+  double old_ns = (bench_now() - t) / (rounds * NWORDS) * 1e9;
+
+  size_t lens[NWORDS];
+  for (size_t w = 0; w < NWORDS; w++)
+    lens[w] = strlen(words[w]);
+  t = bench_now();
+  for (long r = 0; r < rounds; r++) {
+    for (size_t w = 0; w < NWORDS; w++) {
+      strbuf_reset(&buf);
+      expand_word_into(words[w], lens[w], &buf);
+    }
+  }
+  double new_ns = (bench_now() - t) / (rounds * NWORDS) * 1e9;
+  strbuf_free(&buf);
+
+  printf("expand: process_quotes+expand_tilde %6.1f ns/word\n", old_ns);
+  printf("expand: expand_word_into            %6.1f ns/word  (%.1fx)\n",
+         new_ns, old_ns / new_ns);
+  return 0;
+}
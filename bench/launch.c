@@ -0,0 +1,102 @@
+/* Launch latency of mu_spawn() against mu_fork() + exec as the shell's
+   resident size grows: fork copies the page tables, so its cost follows
+   RSS, while posix_spawn's vfork-style clone shares them.  Each launch
+   runs /bin/true and waits for it.  */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "cmdhash.h"
+#include "launch.h"
+
+static long rss_mb(void) {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+      resident = 0;
+    fclose(f);
+  }
+  return resident * sysconf(_SC_PAGESIZE) >> 20;
+}
+
+// 0 once pid has exited, or -1 if it can't be waited for
+static int wait_child(pid_t pid) {
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      perror("launch: waitpid");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Microseconds per launch, or -1 if a command could not be started or
+// waited for
+static double time_spawn(char **args, int n) {
+  double t = bench_now();
+  for (int i = 0; i < n; i++) {
+    pid_t pid = mu_spawn(args, 0, 0, STDIN_FILENO, STDOUT_FILENO,
+                         STDERR_FILENO, NULL);
+    if (pid < 0)
+      return -1;
+    if (wait_child(pid) < 0)
+      return -1;
+  }
+  return (bench_now() - t) / n * 1e6;
+}
+
+static double time_fork(char **args, int n) {
+  double t = bench_now();
+  for (int i = 0; i < n; i++) {
+    pid_t pid = mu_fork();
+    if (pid == 0) {
+      cmdhash_exec(args);
+      _exit(127);
+    }
+    if (pid < 0)
+      return -1;
+    if (wait_child(pid) < 0)
+      return -1;
+  }
+  return (bench_now() - t) / n * 1e6;
+}
+
+int main(int argc, char **argv) {
+  static const long default_sizes[] = {0, 100, 500};
+  int nsizes = argc > 1 ? argc - 1 : 3;
+  int n = 200;
+  char *args[] = {"/bin/true", NULL};
+
+  printf("launch: %8s %12s %12s\n", "RSS", "spawn", "fork");
+  for (int k = 0; k < nsizes; k++) {
+    long mb = argc > 1 ? atol(argv[k + 1]) : default_sizes[k];
+
+    // Touched heap, as history, caches and job tables would be
+    size_t bytes = (size_t)mb << 20;
+    char *heap = bytes ? malloc(bytes) : NULL;
+    if (bytes && !heap) {
+      perror("malloc");
+      return 1;
+    }
+    if (heap)
+      memset(heap, 1, bytes);
+
+    double spawn_us = time_spawn(args, n);
+    double fork_us = time_fork(args, n);
+    if (spawn_us < 0 || fork_us < 0) {
+      perror("launch: /bin/true");
+      return 1;
+    }
+    printf("launch: %5ld MB %9.0f us %9.0f us\n", rss_mb(), spawn_us,
+           fork_us);
+    free(heap);
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+/* tokenize() throughput on long synthetic lines, as tooling generates
+   them, with each scanner implementation forced in turn.  The scalar
+   one is the lookup-table loop non-x86 builds use.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "bench.h"
+#include "scan.h"
+#include "tokenizer.h"
+
+// Long options and quoted values, the shape of a generated kubectl line
+static char *make_line(size_t size) {
+  static const char *parts[] = {
+      "--namespace=production-cluster-east-1 ",
+      "--selector=app.kubernetes.io/name=frontend,tier=web ",
+      "\"--annotation=description=a quoted value with spaces in it\" ",
+      "'--literal=single quoted text that is skipped with memchr' ",
+      "--output=jsonpath={.items[*].metadata.name} ",
+      "--env=HOME=$HOME ",
+      "| grep -v terminating ",
+  };
+  size_t nparts = sizeof(parts) / sizeof(parts[0]);
+  char *line = malloc(size + 64);
+  size_t len = 0;
+
+  for (size_t i = 0; len < size; i++) {
+    const char *p = parts[i % nparts];
+    size_t n = strlen(p);
+    memcpy(line + len, p, n);
+    len += n;
+  }
+  line[len] = '\0';
+  return line;
+}
+
+int main(int argc, char **argv) {
+  size_t size = (argc > 1 ? atol(argv[1]) : 8) << 20;
+  static const char *impls[] = {"scalar", "sse2", "avx2"};
+  char *line = make_line(size);
+  size_t len = strlen(line);
+  Arena arena;
+
+  arena_init(&arena);
+  for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); k++) {
+    if (scan_select(impls[k]) < 0) {
+      printf("tokenize: %-6s not available\n", impls[k]);
+      continue;
+    }
+
+    // Best of a few runs; the first also warms the token array
+    double best = 0;
+    for (int run = 0; run < 5; run++) {
+      double t = bench_now();
+      tokenize(line, &arena);
+      t = bench_now() - t;
+      if (run == 0 || t < best)
+        best = t;
+      arena_reset(&arena);
+    }
+    printf("tokenize: %-6s %7.1f MB/s  (%zu MB line)\n", impls[k],
+           len / best / 1e6, len >> 20);
+  }
+
+  arena_free(&arena);
+  free(line);
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN (sizeof(void *) * 2)
+
+/* High-water mark over every arena in the process, for debug reports.  */
+static size_t arena_peak_total = 0;
+
+void arena_init(Arena *a) { memset(a, 0, sizeof(*a)); }
+
+static ArenaBlock *arena_new_block(Arena *a, size_t min_size) {
+  size_t size = ARENA_BLOCK_SIZE;
+
+  // Grow block sizes geometrically so long lines need few mallocs
+  if (a->head && a->head->size * 2 <= ARENA_MAX_BLOCK_SIZE)
+    size = a->head->size * 2;
+  if (size < min_size)
+    size = min_size;
+
+  ArenaBlock *b = malloc(sizeof(ArenaBlock) + size);
+  if (!b) {
+    perror("malloc");
+    exit(1);
+  }
+  b->next = a->head;
+  b->used = 0;
+  b->size = size;
+  a->head = b;
+
+  a->reserved += size;
+  if (a->reserved > a->peak)
+    a->peak = a->reserved;
+  if (a->reserved > arena_peak_total)
+    arena_peak_total = a->reserved;
+  return b;
+}
+
+/* Carve `size` bytes starting at a multiple of `align` (a power of two)
+   into the current block.  */
+static void *arena_bump(Arena *a, size_t size, size_t align) {
+  ArenaBlock *b = a->head;
+  size_t used = b ? (b->used + align - 1) & ~(align - 1) : 0;
+
+  if (!b || used > b->size || b->size - used < size) {
+    b = arena_new_block(a, size);
+    used = 0;
+  }
+
+  void *p = b->data + used;
+  b->used = used + size;
+  a->allocs++;
+  a->bytes += size;
+  return p;
+}
+
+void *arena_alloc(Arena *a, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if (size == 0)
+    size = ARENA_ALIGN;
+  return arena_bump(a, size, ARENA_ALIGN);
+}
+
+void *arena_calloc(Arena *a, size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size) {
+    fprintf(stderr, "mu: arena allocation overflow\n");
+    exit(1);
+  }
+  void *p = arena_alloc(a, count * size);
+  memset(p, 0, count * size);
+  return p;
+}
+
+/* Strings are packed byte to byte; they need no alignment and words
+   split from large command output are mostly short.  */
+char *arena_strndup(Arena *a, const char *s, size_t n) {
+  char *p = arena_bump(a, n + 1, 1);
+  memcpy(p, s, n);
+  p[n] = '\0';
+  return p;
+}
+
+char *arena_strdup(Arena *a, const char *s) {
+  return arena_strndup(a, s, strlen(s));
+}
+
+/* Release everything but keep one default-sized block around, so the
+   next line can be parsed without touching malloc at all.  */
+void arena_reset(Arena *a) {
+  ArenaBlock *keep = NULL;
+  ArenaBlock *b = a->head;
+
+  while (b) {
+    ArenaBlock *next = b->next;
+    if (!keep && b->size == ARENA_BLOCK_SIZE) {
+      keep = b;
+    } else {
+      free(b);
+    }
+    b = next;
+  }
+
+  a->head = keep;
+  a->reserved = 0;
+  if (keep) {
+    keep->next = NULL;
+    keep->used = 0;
+    a->reserved = keep->size;
+  }
+  a->allocs = 0;
+  a->bytes = 0;
+}
+
+void arena_free(Arena *a) {
+  ArenaBlock *b = a->head;
+  while (b) {
+    ArenaBlock *next = b->next;
+    free(b);
+    b = next;
+  }
+  a->head = NULL;
+  a->allocs = 0;
+  a->bytes = 0;
+  a->reserved = 0;
+}
+
+void arena_report(const Arena *a, const char *label) {
+  fprintf(stderr,
+          "DEBUG arena (%s): %zu allocations, %zu bytes used, %zu bytes "
+          "reserved, peak %zu (process peak %zu)\n",
+          label, a->allocs, a->bytes, a->reserved, a->peak,
+          arena_peak_total);
+}
@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE 4096
+#define ARENA_MAX_BLOCK_SIZE (64 * 1024)
+
+// Bump allocator for data that shares one lifetime, such as the tokens and
+// AST of a single command line. Individual allocations are never freed;
+// everything goes away together in arena_reset()/arena_free().
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  size_t used;
+  size_t size;
+  char data[];
+} ArenaBlock;
+
+typedef struct Arena {
+  ArenaBlock *head; /* block currently being carved, newest first */
+  size_t allocs;    /* allocations since the last reset */
+  size_t bytes;     /* bytes handed out since the last reset */
+  size_t reserved;  /* bytes held in blocks */
+  size_t peak;      /* largest `reserved` seen by this arena */
+} Arena;
+
+void arena_init(Arena *a);
+void *arena_alloc(Arena *a, size_t size);
+void *arena_calloc(Arena *a, size_t count, size_t size);
+char *arena_strndup(Arena *a, const char *s, size_t n);
+char *arena_strdup(Arena *a, const char *s);
+void arena_reset(Arena *a);
+void arena_free(Arena *a);
+void arena_report(const Arena *a, const char *label);
+
+#endif
@@ -0,0 +1,274 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "argv.h"
+#include "expand.h"
+
+#define ARGV_INITIAL_CAP 16
+
+// Linux also refuses any single argument longer than this (MAX_ARG_STRLEN)
+#define ARGV_MAX_STRLEN (32 * 4096)
+
+extern char **environ;
+
+ArgvBuilder *argv_new(void) {
+  ArgvBuilder *b = calloc(1, sizeof(ArgvBuilder));
+  if (!b) {
+    perror("calloc");
+    exit(1);
+  }
+  b->cap = ARGV_INITIAL_CAP;
+  b->argv = malloc(sizeof(char *) * b->cap);
+  if (!b->argv) {
+    perror("malloc");
+    exit(1);
+  }
+  b->argv[0] = NULL;
+  arena_init(&b->arena);
+  return b;
+}
+
+static void push(ArgvBuilder *b, char *arg, size_t len) {
+  if (b->argc + 1 >= b->cap) {
+    int cap = b->cap * 2;
+    char **argv = realloc(b->argv, sizeof(char *) * cap);
+    if (!argv) {
+      perror("realloc");
+      exit(1);
+    }
+    b->argv = argv;
+    b->cap = cap;
+  }
+  b->argv[b->argc++] = arg;
+  b->argv[b->argc] = NULL;
+  b->bytes += len + 1 + sizeof(char *);
+}
+
+/* Append an argument.  The string must live as long as the builder.  */
+void argv_push(ArgvBuilder *b, char *arg) { push(b, arg, strlen(arg)); }
+
+/* Expand a word from the parse tree and append it.  */
+void argv_add_word(ArgvBuilder *b, const Word *word) {
+  if (!(word->flags & (WORD_QUOTED | WORD_ESCAPED | WORD_DOLLAR | WORD_TILDE))) {
+    push(b, arena_strndup(&b->arena, word->text, word->len), word->len);
+    return;
+  }
+
+  // Expanded into a buffer reused across words, then bump-copied
+  static StrBuf scratch;
+  strbuf_reset(&scratch);
+  expand_word_into(word->text, word->len, &scratch);
+  push(b, arena_strndup(&b->arena, scratch.data ? scratch.data : "",
+                       scratch.len),
+       scratch.len);
+}
+
+/* Append the fields collected by a splitter and release its list.  The
+   strings themselves already live in the builder's arena.  */
+void argv_add_fields(ArgvBuilder *b, FieldSplitter *s) {
+  if (s->count > b->argc) {
+    // Large output: adopt the field list as the argument array rather
+    // than copying every pointer into a second array as big
+    int cap = b->argc + s->count + 1;
+    if (cap < s->cap)
+      cap = s->cap;
+    char **argv = realloc(s->fields, sizeof(char *) * cap);
+    if (!argv) {
+      perror("realloc");
+      exit(1);
+    }
+    memmove(argv + b->argc, argv, sizeof(char *) * s->count);
+    memcpy(argv, b->argv, sizeof(char *) * b->argc);
+    free(b->argv);
+    b->argv = argv;
+    b->cap = cap;
+  } else {
+    if (b->argc + s->count + 1 > b->cap) {
+      int cap = b->cap;
+      while (b->argc + s->count + 1 > cap)
+        cap *= 2;
+      char **argv = realloc(b->argv, sizeof(char *) * cap);
+      if (!argv) {
+        perror("realloc");
+        exit(1);
+      }
+      b->argv = argv;
+      b->cap = cap;
+    }
+    if (s->count)
+      memcpy(b->argv + b->argc, s->fields, sizeof(char *) * s->count);
+    free(s->fields);
+  }
+  b->argc += s->count;
+  b->argv[b->argc] = NULL;
+  b->bytes += s->bytes;
+
+  s->fields = NULL;
+  s->count = s->cap = 0;
+  s->bytes = 0;
+}
+
+/* SPLIT_SEP: at the start or after a non-whitespace separator, where
+   another one ends an empty field.  SPLIT_SOFT: after IFS whitespace,
+   which may still be followed by one non-whitespace separator.  */
+enum { SPLIT_SEP, SPLIT_SOFT, SPLIT_FIELD };
+
+void splitter_init(FieldSplitter *s, ArgvBuilder *b) {
+  memset(s, 0, sizeof(*s));
+  s->b = b;
+  s->state = SPLIT_SEP;
+  strbuf_init(&s->partial);
+  strbuf_init(&s->held);
+
+  const char *ifs = getenv("IFS");
+  if (!ifs)
+    ifs = " \t\n";
+  s->whole = *ifs == '\0';
+
+  for (const char *c = ifs; *c; c++) {
+    s->is_sep[(unsigned char)*c] = 1;
+    if (*c == ' ' || *c == '\t' || *c == '\n')
+      s->is_space[(unsigned char)*c] = 1;
+  }
+}
+
+static void push_field(FieldSplitter *s, char *field, size_t n) {
+  if (s->count == s->cap) {
+    int cap = s->cap ? s->cap * 2 : ARGV_INITIAL_CAP;
+    char **fields = realloc(s->fields, sizeof(char *) * cap);
+    if (!fields) {
+      perror("realloc");
+      exit(1);
+    }
+    s->fields = fields;
+    s->cap = cap;
+  }
+  s->fields[s->count++] = field;
+  s->bytes += n + 1 + sizeof(char *);
+}
+
+/* End the field p[0..n) at the separator p[n].  It is cut in place unless
+   an earlier chunk holds its start in `partial`.  */
+static void end_field(FieldSplitter *s, char *p, size_t n) {
+  if (s->partial.len) {
+    strbuf_append(&s->partial, p, n);
+    n = s->partial.len;
+    push_field(s, arena_strndup(&s->b->arena, s->partial.data, n), n);
+    strbuf_reset(&s->partial);
+  } else {
+    p[n] = '\0';
+    push_field(s, p, n);
+  }
+}
+
+/* Each chunk is copied into the arena once and its fields are cut out
+   of the copy.  IFS whitespace runs count as one separator and are
+   trimmed at the ends; any other IFS character ends exactly one
+   field.  */
+static void split(FieldSplitter *s, const char *data, size_t n) {
+  if (s->whole) {
+    strbuf_append(&s->partial, data, n);
+    return;
+  }
+
+  char *p = arena_strndup(&s->b->arena, data, n);
+  char *end = p + n;
+
+  while (p < end) {
+    unsigned char c = *p;
+
+    if (s->state == SPLIT_FIELD) {
+      char *start = p;
+      while (p < end && !s->is_sep[(unsigned char)*p])
+        p++;
+      if (p == end) {
+        strbuf_append(&s->partial, start, p - start);
+        return;
+      }
+      c = *p;
+      end_field(s, start, p - start);
+      s->state = s->is_space[c] ? SPLIT_SOFT : SPLIT_SEP;
+      p++;
+    } else if (s->is_space[c]) {
+      p++;
+    } else if (s->is_sep[c]) {
+      if (s->state == SPLIT_SEP)
+        end_field(s, p, 0);
+      s->state = SPLIT_SEP;
+      p++;
+    } else {
+      s->state = SPLIT_FIELD;
+    }
+  }
+}
+
+/* Split the next chunk of output.  Trailing newlines are removed from
+   command output before it is split, so a chunk's final newlines are
+   held back until it is known whether anything follows them.  */
+void splitter_feed(FieldSplitter *s, const char *data, size_t n) {
+  size_t keep = n;
+  while (keep > 0 && data[keep - 1] == '\n')
+    keep--;
+
+  if (keep == 0) {
+    strbuf_append(&s->held, data, n);
+    return;
+  }
+
+  if (s->held.len) {
+    split(s, s->held.data, s->held.len);
+    strbuf_reset(&s->held);
+  }
+  split(s, data, keep);
+  strbuf_append(&s->held, data + keep, n - keep);
+}
+
+/* End of output: the last field is complete and held newlines dropped.  */
+void splitter_finish(FieldSplitter *s) {
+  if (s->partial.len)
+    push_field(s, arena_strndup(&s->b->arena, s->partial.data, s->partial.len),
+               s->partial.len);
+  strbuf_free(&s->partial);
+  strbuf_free(&s->held);
+}
+
+/* Check the argument list against what execve accepts before anything is
+   started.  Returns 0 if it fits, or prints an error and returns 1.  */
+int argv_check_size(const ArgvBuilder *b) {
+  long arg_max = sysconf(_SC_ARG_MAX);
+  if (arg_max <= 0)
+    arg_max = _POSIX_ARG_MAX;
+
+  size_t total = b->bytes + sizeof(char *);
+  for (char **env = environ; *env; env++)
+    total += strlen(*env) + 1 + sizeof(char *);
+
+  if (total > (size_t)arg_max) {
+    fprintf(stderr,
+            "mu: %s: argument list too long (%zu bytes, limit %ld)\n",
+            b->argv[0], total, arg_max);
+    return 1;
+  }
+
+  for (int i = 0; i < b->argc; i++) {
+    size_t len = strlen(b->argv[i]) + 1;
+    if (len > ARGV_MAX_STRLEN) {
+      fprintf(stderr,
+              "mu: %s: argument %d too long (%zu bytes, limit %d)\n",
+              b->argv[0], i, len, ARGV_MAX_STRLEN);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void argv_free(ArgvBuilder *b) {
+  if (!b)
+    return;
+  free(b->argv);
+  arena_free(&b->arena);
+  free(b);
+}
@@ -0,0 +1,55 @@
+#ifndef ARGV_H
+#define ARGV_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "expand.h"
+#include "tokenizer.h"
+
+// Builds the argument vector for one command. The pointer array grows
+// geometrically and every word lives in the builder's arena, including
+// the fields split from command substitution output. Everything is
+// released by argv_free().
+
+typedef struct ArgvBuilder {
+  char **argv;    /* NULL-terminated */
+  int argc;
+  int cap;
+  size_t bytes;   /* what execve would copy: strings plus pointers */
+  Arena arena;    /* expanded words */
+  int subst_status; /* exit status of the last command substitution */
+} ArgvBuilder;
+
+// Splits command substitution output on $IFS a read at a time, rather
+// than collecting all of it and splitting afterwards. Each chunk is
+// copied into the builder's arena once and its fields are cut out in
+// place; they are collected here until argv_add_fields() appends them,
+// which keeps argument order when several substitutions are read at once.
+
+typedef struct FieldSplitter {
+  ArgvBuilder *b;
+  char **fields;
+  int count;
+  int cap;
+  size_t bytes;
+  int state;
+  int whole;      /* empty $IFS: the output is a single field */
+  StrBuf partial; /* field cut in two by the end of a chunk */
+  StrBuf held;    /* newlines that may turn out to end the output */
+  unsigned char is_sep[256];
+  unsigned char is_space[256];
+} FieldSplitter;
+
+ArgvBuilder *argv_new(void);
+void argv_push(ArgvBuilder *b, char *arg);
+void argv_add_word(ArgvBuilder *b, const Word *word);
+void argv_add_fields(ArgvBuilder *b, FieldSplitter *s);
+int argv_check_size(const ArgvBuilder *b);
+void argv_free(ArgvBuilder *b);
+
+void splitter_init(FieldSplitter *s, ArgvBuilder *b);
+void splitter_feed(FieldSplitter *s, const char *data, size_t n);
+void splitter_finish(FieldSplitter *s);
+
+#endif
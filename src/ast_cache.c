@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "ast_cache.h"
+#include "execute.h"
+#include "tokenizer.h"
+
+unsigned long ast_cache_hits = 0;
+unsigned long ast_cache_misses = 0;
+
+static AstCacheEntry *buckets[AST_CACHE_BUCKETS];
+static AstCacheEntry *lru_head = NULL; /* most recently used */
+static AstCacheEntry *lru_tail = NULL; /* eviction candidate */
+static int entry_count = 0;
+
+/* FNV-1a over the line text.  */
+static unsigned long hash_line(const char *line, size_t len) {
+  unsigned long h = 2166136261UL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)line[i];
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+static void lru_unlink(AstCacheEntry *e) {
+  if (e->lru_prev)
+    e->lru_prev->lru_next = e->lru_next;
+  else
+    lru_head = e->lru_next;
+  if (e->lru_next)
+    e->lru_next->lru_prev = e->lru_prev;
+  else
+    lru_tail = e->lru_prev;
+  e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push_front(AstCacheEntry *e) {
+  e->lru_prev = NULL;
+  e->lru_next = lru_head;
+  if (lru_head)
+    lru_head->lru_prev = e;
+  lru_head = e;
+  if (!lru_tail)
+    lru_tail = e;
+}
+
+static void free_entry(AstCacheEntry *e) {
+  arena_free(&e->arena);
+  free(e);
+}
+
+static void remove_entry(AstCacheEntry *e) {
+  AstCacheEntry **link = &buckets[e->hash % AST_CACHE_BUCKETS];
+  while (*link != e)
+    link = &(*link)->hash_next;
+  *link = e->hash_next;
+
+  lru_unlink(e);
+  entry_count--;
+  free_entry(e);
+}
+
+/* Drop least recently used entries until the cache is back under its
+   limit.  Entries whose tree is still executing are skipped.  */
+static void evict(void) {
+  AstCacheEntry *e = lru_tail;
+  while (entry_count > AST_CACHE_SIZE && e) {
+    AstCacheEntry *prev = e->lru_prev;
+    if (!e->busy)
+      remove_entry(e);
+    e = prev;
+  }
+}
+
+/* Return the parsed tree for a line, parsing it on a miss.  The entry stays
+   pinned until ast_cache_release().  Returns NULL on a parse error.  */
+AstCacheEntry *ast_cache_acquire(const char *line) {
+  size_t len = strlen(line);
+  unsigned long hash = hash_line(line, len);
+  int cacheable = len <= AST_CACHE_MAX_LINE;
+
+  if (cacheable) {
+    for (AstCacheEntry *e = buckets[hash % AST_CACHE_BUCKETS]; e;
+         e = e->hash_next) {
+      if (e->hash == hash && e->len == len && memcmp(e->text, line, len) == 0) {
+        ast_cache_hits++;
+        lru_unlink(e);
+        lru_push_front(e);
+        e->busy++;
+        return e;
+      }
+    }
+  }
+
+  ast_cache_misses++;
+
+  AstCacheEntry *e = calloc(1, sizeof(AstCacheEntry));
+  if (!e) {
+    perror("calloc");
+    return NULL;
+  }
+  arena_init(&e->arena);
+  e->hash = hash;
+  e->len = len;
+  e->text = arena_strndup(&e->arena, line, len);
+
+  tokenize(e->text, &e->arena);
+  e->tree = parse_sequence();
+  if (!e->tree) {
+    free_entry(e);
+    return NULL;
+  }
+  mark_exec_tails(e->tree);
+
+  e->busy = 1;
+  e->cached = cacheable;
+  if (cacheable) {
+    AstCacheEntry **bucket = &buckets[hash % AST_CACHE_BUCKETS];
+    e->hash_next = *bucket;
+    *bucket = e;
+    lru_push_front(e);
+    entry_count++;
+    evict();
+  }
+  return e;
+}
+
+void ast_cache_release(AstCacheEntry *entry) {
+  entry->busy--;
+  if (!entry->cached)
+    free_entry(entry);
+  else if (entry_count > AST_CACHE_SIZE)
+    evict();
+}
+
+void ast_cache_report(void) {
+  fprintf(stderr, "DEBUG ast cache: %lu hits, %lu misses, %d entries\n",
+          ast_cache_hits, ast_cache_misses, entry_count);
+}
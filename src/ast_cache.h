@@ -0,0 +1,34 @@
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "tokenizer.h"
+
+#define AST_CACHE_SIZE 64
+#define AST_CACHE_BUCKETS 128
+#define AST_CACHE_MAX_LINE 4096 /* longer lines are parsed but not cached */
+
+// A parsed line. The tree's words still need expanding, so a cached tree
+// stays valid however variables change between runs.
+typedef struct AstCacheEntry {
+  struct AstCacheEntry *hash_next;
+  struct AstCacheEntry *lru_prev, *lru_next;
+  unsigned long hash;
+  const char *text; /* copy of the line in `arena`; words point into it */
+  size_t len;
+  ASTNode *tree;
+  Arena arena; /* owns the text copy and every node of the tree */
+  int busy;    /* executions currently using the tree */
+  int cached;  /* false for one-off entries that are freed on release */
+} AstCacheEntry;
+
+extern unsigned long ast_cache_hits;
+extern unsigned long ast_cache_misses;
+
+AstCacheEntry *ast_cache_acquire(const char *line);
+void ast_cache_release(AstCacheEntry *entry);
+void ast_cache_report(void);
+
+#endif
@@ -1,14 +1,38 @@
+#include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "builtins.h"
+#include "cmdhash.h"
+#include "dag.h"
 #include "job.h"
 #include "job_control.h"
+#include "job_table.h"
+#include "parallel.h"
+#include "reaper.h"
+
+extern pid_t mu_last_bg_pid;
+extern int mu_last_bg_status;
 
 int mu_exit_command = 0;
 
+// Shell options, changed with set -o / set +o
+int mu_opt_lastpipe = 0;
+int mu_opt_serialsubst = 0;
+
+static struct {
+  const char *name;
+  int *flag;
+} mu_options[] = {
+    {"lastpipe", &mu_opt_lastpipe},
+    {"serialsubst", &mu_opt_serialsubst},
+};
+
+#define MU_NUM_OPTIONS (int)(sizeof(mu_options) / sizeof(mu_options[0]))
+
 char *builtin_str[] = {
     "cd",
     "help",
@@ -18,6 +42,12 @@ char *builtin_str[] = {
     "fg",
     "bg",
     "jobs",
+    "hash",
+    "set",
+    "read",
+    "wait",
+    "parallel",
+    "dag",
 };
 
 int (*builtin_func[])(char **) = {
@@ -29,10 +59,24 @@ int (*builtin_func[])(char **) = {
     &mu_fg,
     &mu_bg,
     &mu_jobs,
+    &mu_hash,
+    &mu_set,
+    &mu_read,
+    &mu_wait,
+    &mu_parallel,
+    &mu_dag,
 };
 
 int mu_num_builtins() { return sizeof(builtin_str) / sizeof(char *); }
 
+/* Index of the builtin called `name`, or -1.  */
+int mu_find_builtin(const char *name) {
+  for (int i = 0; i < mu_num_builtins(); i++)
+    if (strcmp(name, builtin_str[i]) == 0)
+      return i;
+  return -1;
+}
+
 int mu_cd(char **args) {
   if (args[1] == NULL) {
     fprintf(stderr, "mu: expected argument to \"cd\"\n");
@@ -73,7 +117,8 @@ int mu_exec(char **args) {
   }
 
   // Skip the "exec" command itself
-  if (execvp(args[1], &args[1]) == -1) {
+  reaper_reset();
+  if (cmdhash_exec(&args[1]) == -1) {
     perror("mu");
   }
 
@@ -88,6 +133,7 @@ int mu_kill(char **args) {
   }
 
   pid_t pid;
+  const char *target;
   int sig = SIGTERM; // default signal
 
   // Check if first argument is a signal
@@ -104,14 +150,32 @@ int mu_kill(char **args) {
       return 1;
     }
     
-    pid = atoi(args[2]);
+    target = args[2];
   } else {
-    pid = atoi(args[1]);
+    target = args[1];
   }
 
-  if (pid <= 0) {
-    fprintf(stderr, "mu: invalid pid\n");
-    return 1;
+  // %job signals the job's process group, or without job control each
+  // of its processes
+  if (target[0] == '%') {
+    job *j = job_table_resolve(target, "kill");
+    if (!j)
+      return 1;
+    if (!j->pgid) {
+      for (process *p = j->first_process; p; p = p->next)
+        if (p->pid > 0 && !p->completed && kill(p->pid, sig) == -1) {
+          perror("mu");
+          return 1;
+        }
+      return 0;
+    }
+    pid = -j->pgid;
+  } else {
+    pid = atoi(target);
+    if (pid <= 0) {
+      fprintf(stderr, "mu: invalid pid\n");
+      return 1;
+    }
   }
 
   if (kill(pid, sig) == -1) {
@@ -123,59 +187,21 @@ int mu_kill(char **args) {
 }
 
 int mu_fg(char **args) {
-  extern job *first_job;
-  
   if (!shell_is_interactive) {
     fprintf(stderr, "mu: fg: no job control in this shell\n");
     return 1;
   }
 
-  job *j = NULL;
-
+  job *j;
   if (args[1] == NULL) {
-    // No argument - find most recent job that can be foregrounded
-    // Priority: stopped jobs first, then running background jobs
-    for (j = first_job; j; j = j->next) {
-      if (job_is_stopped(j)) {
-        break;
-      }
-    }
-    
-    // If no stopped job found, look for any running job
-    if (!j) {
-      for (j = first_job; j; j = j->next) {
-        if (!job_is_completed(j)) {
-          break;
-        }
-      }
-    }
-    
+    // No argument - the current job, %+
+    j = job_table_current();
     if (!j) {
       fprintf(stderr, "mu: fg: no current job\n");
       return 1;
     }
-  } else {
-    // Parse job specification
-    int job_num;
-    if (args[1][0] == '%') {
-      job_num = atoi(&args[1][1]);
-    } else {
-      job_num = atoi(args[1]);
-    }
-    
-    // Find job by number (position in list)
-    int current_num = 1;
-    for (j = first_job; j; j = j->next) {
-      if (current_num == job_num) {
-        break;
-      }
-      current_num++;
-    }
-    
-    if (!j) {
-      fprintf(stderr, "mu: fg: job not found\n");
-      return 1;
-    }
+  } else if (!(j = job_table_resolve(args[1], "fg"))) {
+    return 1;
   }
 
   // Check if job is still valid before continuing
@@ -189,74 +215,48 @@ int mu_fg(char **args) {
 }
 
 int mu_bg(char **args) {
-  extern job *first_job;
-  
   if (!shell_is_interactive) {
     fprintf(stderr, "mu: bg: no job control in this shell\n");
     return 1;
   }
 
-  job *j = NULL;
-
+  job *j;
   if (args[1] == NULL) {
-    // No argument - find most recent stopped job
-    for (j = first_job; j; j = j->next) {
-      if (job_is_stopped(j)) {
-        break;
-      }
-    }
-    
+    // No argument - the current job, %+
+    j = job_table_current();
     if (!j) {
-      fprintf(stderr, "mu: bg: no stopped job\n");
+      fprintf(stderr, "mu: bg: no current job\n");
       return 1;
     }
-  } else {
-    // Parse job specification
-    int job_num;
-    if (args[1][0] == '%') {
-      job_num = atoi(&args[1][1]);
-    } else {
-      job_num = atoi(args[1]);
-    }
-
-    // Find job by number (position in list)
-    int current_num = 1;
-    for (j = first_job; j; j = j->next) {
-      if (current_num == job_num) {
-        break;
-      }
-      current_num++;
-    }
+  } else if (!(j = job_table_resolve(args[1], "bg"))) {
+    return 1;
+  }
 
-    if (!j) {
-      fprintf(stderr, "mu: bg: job not found\n");
-      return 1;
-    }
-    
-    if (!job_is_stopped(j)) {
-      fprintf(stderr, "mu: bg: job is already running\n");
-      return 1;
-    }
+  if (!job_is_stopped(j) || job_is_completed(j)) {
+    fprintf(stderr, "mu: bg: job is already running\n");
+    return 1;
   }
 
   continue_job(j, 0); // 0 = background
   return 0;
 }
 
+/* Jobs by number; + marks the current job and - the previous one.  */
 int mu_jobs() {
-  extern job *first_job;
-  
   if (!shell_is_interactive) {
     fprintf(stderr, "mu: jobs: no job control in this shell\n");
     return 1;
   }
 
-  job *j;
-  int job_num = 1;
+  job *current = job_table_current();
+  job *previous = job_table_previous();
 
-  for (j = first_job; j; j = j->next) {
+  for (int id = 1; id <= job_table_max(); id++) {
+    job *j = job_table_get(id);
     const char *status;
-    
+
+    if (!j)
+      continue;
     if (job_is_completed(j)) {
       status = "Done";
     } else if (job_is_stopped(j)) {
@@ -265,9 +265,256 @@ int mu_jobs() {
       status = "Running";
     }
 
-    printf("[%d]  %s\t\t%s\n", job_num, status, j->command);
-    job_num++;
+    char mark = j == current ? '+' : j == previous ? '-' : ' ';
+    printf("[%d]%c %s\t\t%s\n", id, mark, status, j->command);
   }
 
   return 0;
 }
+
+/* wait [-n] [-t seconds] [%job|pid...]
+   Wait for the given jobs and processes, or every background job, to
+   finish; -n returns as soon as one of them has.  The status is that of
+   the last one given or the one -n returned for, 124 if the -t timeout
+   ran out first, 130 after Ctrl-C and 127 if one of them is unknown.
+   Jobs that finished are forgotten, as a notification would.  */
+int mu_wait(char **args) {
+  int any = 0, timeout_ms = -1;
+  int i = 1;
+
+  for (; args[i] && args[i][0] == '-'; i++) {
+    if (strcmp(args[i], "--") == 0) {
+      i++;
+      break;
+    }
+    if (strcmp(args[i], "-n") == 0) {
+      any = 1;
+    } else if (strcmp(args[i], "-t") == 0 && args[i + 1]) {
+      char *end;
+      double seconds = strtod(args[++i], &end);
+      if (*end || seconds < 0 || seconds > 86400.0 * 24) {
+        fprintf(stderr, "mu: wait: %s: invalid timeout\n", args[i]);
+        return 2;
+      }
+      timeout_ms = (int)(seconds * 1000);
+    } else {
+      fprintf(stderr, "mu: wait: %s: invalid option\n", args[i]);
+      fprintf(stderr, "usage: wait [-n] [-t seconds] [%%job|pid...]\n");
+      return 2;
+    }
+  }
+
+  int given = 0;
+  while (args[i + given])
+    given++;
+
+  int cap = given ? given : job_table_max();
+  wait_target *targets = calloc(cap ? cap : 1, sizeof(wait_target));
+  if (!targets) {
+    perror("calloc");
+    exit(1);
+  }
+
+  int n = 0;
+  int last_done = -1; /* status of the last pid given, if already freed */
+  if (!given) {
+    for (int id = 1; id <= job_table_max(); id++) {
+      job *j = job_table_get(id);
+      if (j && j->is_background)
+        targets[n++].j = j;
+    }
+  }
+  for (int k = 0; k < given; k++) {
+    const char *spec = args[i + k];
+    wait_target *t = &targets[n];
+
+    if (spec[0] == '%') {
+      t->j = job_table_resolve(spec, "wait");
+    } else {
+      char *end;
+      long pid = strtol(spec, &end, 10);
+      if (*end || pid <= 0) {
+        fprintf(stderr, "mu: wait: %s: not a pid or job spec\n", spec);
+        free(targets);
+        return 2;
+      }
+      if ((t->p = job_table_find_pid((pid_t)pid))) {
+        t->j = t->p->job;
+      } else if (pid == mu_last_bg_pid && mu_last_bg_status >= 0) {
+        // $!, whose job finished and was freed: there is nothing to wait
+        // for, only its status
+        if (any) {
+          free(targets);
+          return mu_last_bg_status;
+        }
+        if (k == given - 1)
+          last_done = mu_last_bg_status;
+        continue;
+      } else {
+        fprintf(stderr, "mu: wait: pid %ld is not a child of this shell\n",
+                pid);
+      }
+    }
+    if (!t->j) {
+      free(targets);
+      return 127;
+    }
+    n++;
+  }
+
+  if (n == 0) {
+    free(targets);
+    if (last_done >= 0)
+      return last_done;
+    return any ? 127 : 0;
+  }
+
+  int which = wait_for_targets(targets, n, any, timeout_ms);
+  int status = which == -2 ? 130 : 124;
+  if (which >= 0)
+    status = given || any ? wait_target_status(&targets[which]) : 0;
+  if (which >= 0 && last_done >= 0)
+    status = last_done;
+
+  // Forget what finished, each job once however often it was named
+  for (int k = 0; k < n; k++) {
+    job *j = targets[k].j;
+    if (!j || (any && k != which) || !job_is_completed(j))
+      continue;
+    for (int m = k + 1; m < n; m++)
+      if (targets[m].j == j)
+        targets[m].j = NULL;
+    free_job(j);
+  }
+
+  free(targets);
+  return status;
+}
+
+/* hash          list remembered command paths
+   hash -l       list them with the number of times each was used
+   hash -r       forget all of them
+   hash name...  look the names up now  */
+int mu_hash(char **args) {
+  if (args[1] == NULL) {
+    cmdhash_print(0);
+    return 0;
+  }
+
+  if (strcmp(args[1], "-r") == 0) {
+    cmdhash_clear();
+    return 0;
+  }
+
+  if (strcmp(args[1], "-l") == 0) {
+    printf("  hits\tcommand\tpath\n");
+    cmdhash_print(1);
+    return 0;
+  }
+
+  int status = 0;
+  for (int i = 1; args[i]; i++) {
+    if (!cmdhash_lookup(args[i])) {
+      fprintf(stderr, "mu: hash: %s: not found\n", args[i]);
+      status = 1;
+    }
+  }
+  return status;
+}
+
+/* set -o         list options
+   set -o name    turn an option on
+   set +o name    turn it off  */
+int mu_set(char **args) {
+  if (args[1] == NULL || (strcmp(args[1], "-o") == 0 && args[2] == NULL)) {
+    for (int i = 0; i < MU_NUM_OPTIONS; i++)
+      printf("%-12s\t%s\n", mu_options[i].name,
+             *mu_options[i].flag ? "on" : "off");
+    return 0;
+  }
+
+  int on = strcmp(args[1], "-o") == 0;
+  if ((!on && strcmp(args[1], "+o") != 0) || args[2] == NULL) {
+    fprintf(stderr, "mu: set: usage: set [-o|+o] [option]\n");
+    return 1;
+  }
+
+  for (int i = 0; i < MU_NUM_OPTIONS; i++) {
+    if (strcmp(args[2], mu_options[i].name) == 0) {
+      *mu_options[i].flag = on;
+      return 0;
+    }
+  }
+  fprintf(stderr, "mu: set: %s: invalid option name\n", args[2]);
+  return 1;
+}
+
+/* read [name...]: read one line from stdin and assign its fields to the
+   names (REPLY if none), split on $IFS; the last name gets the rest of
+   the line.  Reads a byte at a time so nothing past the newline is taken
+   from a shared pipe.  Returns 1 at end of input.  */
+int mu_read(char **args) {
+  char *default_args[] = {"read", "REPLY", NULL};
+  if (args[1] == NULL)
+    args = default_args;
+
+  size_t len = 0, cap = 128;
+  char *line = malloc(cap);
+  if (!line) {
+    perror("malloc");
+    return 1;
+  }
+
+  int got_newline = 0;
+  char c;
+  ssize_t n;
+  while ((n = read(STDIN_FILENO, &c, 1)) != 0) {
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("mu: read");
+      break;
+    }
+    if (c == '\n') {
+      got_newline = 1;
+      break;
+    }
+    if (len + 1 >= cap) {
+      cap *= 2;
+      char *bigger = realloc(line, cap);
+      if (!bigger) {
+        perror("realloc");
+        free(line);
+        return 1;
+      }
+      line = bigger;
+    }
+    line[len++] = c;
+  }
+  line[len] = '\0';
+
+  const char *ifs = getenv("IFS");
+  if (!ifs)
+    ifs = " \t\n";
+
+  char *p = line;
+  for (int i = 1; args[i]; i++) {
+    p += strspn(p, ifs);
+    char *end;
+    if (args[i + 1]) {
+      end = p + strcspn(p, ifs);
+      if (*end)
+        *end++ = '\0';
+    } else {
+      // Last name: the rest of the line, minus trailing separators
+      end = p + strlen(p);
+      while (end > p && strchr(ifs, end[-1]))
+        *--end = '\0';
+    }
+    setenv(args[i], p, 1);
+    p = end;
+  }
+
+  free(line);
+  return got_newline || len > 0 ? 0 : 1;
+}
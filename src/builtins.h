@@ -18,9 +18,14 @@ int mu_kill(char **args);
 int mu_fg(char **args);
 int mu_bg(char **args);
 int mu_jobs();
+int mu_hash(char **args);
+int mu_set(char **args);
+int mu_read(char **args);
+int mu_wait(char **args);
 
 // Builtin management
 int mu_num_builtins(void);
+int mu_find_builtin(const char *name);
 
 // External builtin arrays
 extern char *builtin_str[];
@@ -28,5 +33,7 @@ extern int (*builtin_func[])(char **);
 
 // External variables
 extern int mu_exit_command;
+extern int mu_opt_lastpipe;
+extern int mu_opt_serialsubst;
 
 #endif // BUILTINS_H
@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cmdhash.h"
+
+extern char **environ;
+
+static CmdHashEntry *buckets[CMDHASH_BUCKETS];
+static char *hashed_path = NULL; /* $PATH the table was built for */
+
+/* FNV-1a over the command name.  */
+static unsigned long hash_name(const char *name) {
+  unsigned long h = 2166136261UL;
+  for (; *name; name++) {
+    h ^= (unsigned char)*name;
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+void cmdhash_clear(void) {
+  for (int i = 0; i < CMDHASH_BUCKETS; i++) {
+    CmdHashEntry *e = buckets[i];
+    while (e) {
+      CmdHashEntry *next = e->next;
+      free(e->name);
+      free(e->path);
+      free(e);
+      e = next;
+    }
+    buckets[i] = NULL;
+  }
+}
+
+/* Drop the table if $PATH is no longer what it was built from.  */
+static void check_path(void) {
+  const char *path = getenv("PATH");
+  if (!path)
+    path = "/usr/bin:/bin";
+
+  if (hashed_path && strcmp(hashed_path, path) == 0)
+    return;
+
+  cmdhash_clear();
+  free(hashed_path);
+  hashed_path = strdup(path);
+}
+
+/* Walk $PATH the way execvp does: the first regular, executable file
+   wins and an empty entry means the current directory.  */
+static char *search_path(const char *name) {
+  char candidate[PATH_MAX];
+  size_t name_len = strlen(name);
+  const char *dir = hashed_path;
+
+  while (dir) {
+    const char *colon = strchr(dir, ':');
+    size_t dir_len = colon ? (size_t)(colon - dir) : strlen(dir);
+
+    if (dir_len + name_len + 2 <= sizeof(candidate)) {
+      if (dir_len == 0) {
+        memcpy(candidate, name, name_len + 1);
+      } else {
+        memcpy(candidate, dir, dir_len);
+        candidate[dir_len] = '/';
+        memcpy(candidate + dir_len + 1, name, name_len + 1);
+      }
+
+      struct stat st;
+      if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+          access(candidate, X_OK) == 0)
+        return strdup(candidate);
+    }
+
+    dir = colon ? colon + 1 : NULL;
+  }
+  return NULL;
+}
+
+/* Return the path to run for `name`, searching $PATH on the first use.
+   Names containing a slash are used as they are.  Returns NULL if the
+   command is not found.  */
+const char *cmdhash_lookup(const char *name) {
+  if (strchr(name, '/'))
+    return name;
+
+  check_path();
+
+  unsigned long h = hash_name(name) % CMDHASH_BUCKETS;
+  for (CmdHashEntry *e = buckets[h]; e; e = e->next) {
+    if (strcmp(e->name, name) == 0) {
+      e->hits++;
+      return e->path;
+    }
+  }
+
+  char *path = search_path(name);
+  if (!path)
+    return NULL;
+
+  CmdHashEntry *e = malloc(sizeof(CmdHashEntry));
+  if (!e) {
+    free(path);
+    return NULL;
+  }
+  e->name = strdup(name);
+  e->path = path;
+  e->hits = 1;
+  e->next = buckets[h];
+  buckets[h] = e;
+  return e->path;
+}
+
+/* Forget a command whose cached path has gone away.  */
+void cmdhash_forget(const char *name) {
+  CmdHashEntry **link = &buckets[hash_name(name) % CMDHASH_BUCKETS];
+  while (*link) {
+    CmdHashEntry *e = *link;
+    if (strcmp(e->name, name) == 0) {
+      *link = e->next;
+      free(e->name);
+      free(e->path);
+      free(e);
+      return;
+    }
+    link = &e->next;
+  }
+}
+
+void cmdhash_print(int with_hits) {
+  for (int i = 0; i < CMDHASH_BUCKETS; i++) {
+    for (CmdHashEntry *e = buckets[i]; e; e = e->next) {
+      if (with_hits)
+        printf("%6lu\t%s\t%s\n", e->hits, e->name, e->path);
+      else
+        printf("%s\t%s\n", e->name, e->path);
+    }
+  }
+}
+
+/* execve() args[0] through the table.  A cached path that no longer
+   exists is forgotten and PATH searched again.  Only returns on failure,
+   with errno set.  */
+int cmdhash_exec(char **args) {
+  const char *path = cmdhash_lookup(args[0]);
+  if (!path) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  execve(path, args, environ);
+  if (errno == ENOENT && path != args[0]) {
+    cmdhash_forget(args[0]);
+    path = cmdhash_lookup(args[0]);
+    if (path)
+      execve(path, args, environ);
+  }
+
+  // Not a binary: let execvp hand it to /bin/sh
+  if (errno == ENOEXEC)
+    execvp(args[0], args);
+  return -1;
+}
@@ -0,0 +1,22 @@
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+// Command name -> absolute path, so PATH is searched once per command
+// instead of once per exec. The table is dropped whenever $PATH changes.
+
+#define CMDHASH_BUCKETS 64
+
+typedef struct CmdHashEntry {
+  struct CmdHashEntry *next;
+  char *name;
+  char *path;
+  unsigned long hits;
+} CmdHashEntry;
+
+const char *cmdhash_lookup(const char *name);
+void cmdhash_forget(const char *name);
+void cmdhash_clear(void);
+void cmdhash_print(int with_hits);
+int cmdhash_exec(char **args);
+
+#endif
@@ -0,0 +1,555 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ast_cache.h"
+#include "dag.h"
+#include "execute.h"
+#include "job.h"
+#include "job_control.h"
+#include "signal_handlers.h"
+
+typedef enum {
+  TASK_WAITING,
+  TASK_RUNNING,
+  TASK_OK,
+  TASK_FAILED,
+  TASK_CANCELLED,
+} TaskState;
+
+typedef struct DagTask {
+  char *name;
+  char *command;
+  int line;
+  char **dep_names; /* as written, until they are looked up */
+  int ndep_names;
+  int *deps; /* tasks this one depends on */
+  int ndeps;
+  int *dependents; /* tasks that depend on this one */
+  int ndependents, dependents_cap;
+  int pending; /* dependencies that haven't succeeded yet */
+  int hash_next;
+  TaskState state;
+  AstCacheEntry *ast;
+  job *j;
+  int status;
+  double start, end;
+  double path; /* longest chain of durations ending with this task */
+  int via;     /* the dependency before it on that chain, or -1 */
+} DagTask;
+
+typedef struct Dag {
+  DagTask *tasks;
+  int count, cap;
+  int *buckets; /* task names hashed; -1 ends a chain */
+  int nbuckets;
+} Dag;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *xrealloc(void *p, size_t size) {
+  p = realloc(p, size);
+  if (!p) {
+    perror("realloc");
+    exit(1);
+  }
+  return p;
+}
+
+/* FNV-1a, as in the command hash.  */
+static int *name_bucket(Dag *d, const char *name) {
+  unsigned long h = 2166136261UL;
+  for (; *name; name++) {
+    h ^= (unsigned char)*name;
+    h *= 16777619UL;
+  }
+  return &d->buckets[h % d->nbuckets];
+}
+
+static int find_task(Dag *d, const char *name) {
+  int i = *name_bucket(d, name);
+  while (i >= 0 && strcmp(d->tasks[i].name, name) != 0)
+    i = d->tasks[i].hash_next;
+  return i;
+}
+
+/* Add the task on one line of the spec: `name [dep...]: command`.
+   Blank lines and lines starting with # are skipped.  */
+static int parse_line(Dag *d, char *line, int lineno) {
+  while (isspace((unsigned char)*line))
+    line++;
+  if (*line == '\0' || *line == '#')
+    return 0;
+
+  char *colon = strchr(line, ':');
+  char *command = colon ? colon + 1 : NULL;
+  while (command && isspace((unsigned char)*command))
+    command++;
+  if (!command || *command == '\0') {
+    fprintf(stderr,
+            "mu: dag: line %d: expected `name [dependency...]: command'\n",
+            lineno);
+    return 1;
+  }
+  *colon = '\0';
+  size_t len = strlen(command);
+  while (len > 0 && isspace((unsigned char)command[len - 1]))
+    command[--len] = '\0';
+
+  if (d->count == d->cap) {
+    d->cap = d->cap ? d->cap * 2 : 16;
+    d->tasks = xrealloc(d->tasks, sizeof(DagTask) * d->cap);
+  }
+  DagTask *t = &d->tasks[d->count++];
+  memset(t, 0, sizeof(DagTask));
+  t->line = lineno;
+  t->command = strdup(command);
+  t->via = -1;
+
+  // The first word names the task, the rest are its dependencies
+  for (char *word = strtok(line, " \t"); word; word = strtok(NULL, " \t")) {
+    if (!t->name) {
+      t->name = strdup(word);
+      continue;
+    }
+    t->dep_names =
+        xrealloc(t->dep_names, sizeof(char *) * (t->ndep_names + 1));
+    t->dep_names[t->ndep_names++] = strdup(word);
+  }
+  if (!t->name) {
+    fprintf(stderr, "mu: dag: line %d: task has no name\n", lineno);
+    return 1;
+  }
+  return 0;
+}
+
+static void add_dependent(DagTask *t, int dependent) {
+  if (t->ndependents == t->dependents_cap) {
+    t->dependents_cap = t->dependents_cap ? t->dependents_cap * 2 : 4;
+    t->dependents = xrealloc(t->dependents, sizeof(int) * t->dependents_cap);
+  }
+  t->dependents[t->ndependents++] = dependent;
+}
+
+/* Look up every dependency by name and fill in `order` so each task
+   comes after all of its dependencies.  Prints what is wrong and returns
+   1 for a name used twice, a dependency that doesn't exist or a cycle.  */
+static int link_tasks(Dag *d, int *order) {
+  d->nbuckets = d->count * 2 + 1;
+  d->buckets = malloc(sizeof(int) * d->nbuckets);
+  if (!d->buckets) {
+    perror("malloc");
+    exit(1);
+  }
+  for (int b = 0; b < d->nbuckets; b++)
+    d->buckets[b] = -1;
+
+  for (int i = 0; i < d->count; i++) {
+    DagTask *t = &d->tasks[i];
+    int other = find_task(d, t->name);
+    if (other >= 0) {
+      fprintf(stderr, "mu: dag: line %d: %s: already defined on line %d\n",
+              t->line, t->name, d->tasks[other].line);
+      return 1;
+    }
+    int *bucket = name_bucket(d, t->name);
+    t->hash_next = *bucket;
+    *bucket = i;
+  }
+
+  for (int i = 0; i < d->count; i++) {
+    DagTask *t = &d->tasks[i];
+    int ndeps = 0;
+    t->deps = malloc(sizeof(int) * (t->ndep_names ? t->ndep_names : 1));
+    if (!t->deps) {
+      perror("malloc");
+      exit(1);
+    }
+    for (int k = 0; k < t->ndep_names; k++) {
+      int dep = find_task(d, t->dep_names[k]);
+      if (dep < 0) {
+        fprintf(stderr, "mu: dag: line %d: %s: no such task %s\n", t->line,
+                t->name, t->dep_names[k]);
+        return 1;
+      }
+      int seen = 0;
+      for (int m = 0; m < ndeps; m++)
+        seen |= t->deps[m] == dep;
+      if (seen)
+        continue;
+      t->deps[ndeps++] = dep;
+      add_dependent(&d->tasks[dep], i);
+    }
+    t->ndeps = t->pending = ndeps;
+  }
+
+  // Kahn's algorithm; `pending` is used as the count of unplaced deps
+  int head = 0, tail = 0;
+  for (int i = 0; i < d->count; i++)
+    if (d->tasks[i].pending == 0)
+      order[tail++] = i;
+  while (head < tail) {
+    DagTask *t = &d->tasks[order[head++]];
+    for (int k = 0; k < t->ndependents; k++)
+      if (--d->tasks[t->dependents[k]].pending == 0)
+        order[tail++] = t->dependents[k];
+  }
+
+  if (tail < d->count) {
+    fprintf(stderr, "mu: dag: dependency cycle; these can never start:");
+    for (int i = 0; i < d->count; i++)
+      if (d->tasks[i].pending > 0)
+        fprintf(stderr, " %s", d->tasks[i].name);
+    fputc('\n', stderr);
+    return 1;
+  }
+
+  for (int i = 0; i < d->count; i++)
+    d->tasks[i].pending = d->tasks[i].ndeps;
+  return 0;
+}
+
+/* Cancel everything downstream of t that hasn't started.  */
+static void cancel_dependents(Dag *d, DagTask *t) {
+  for (int k = 0; k < t->ndependents; k++) {
+    DagTask *dep = &d->tasks[t->dependents[k]];
+    if (dep->state != TASK_WAITING)
+      continue;
+    dep->state = TASK_CANCELLED;
+    cancel_dependents(d, dep);
+  }
+}
+
+/* Launch a task in the background, the way `command &` would be.  A
+   task that can't be made into a job fails like a run that returned 1,
+   and -1 is returned.  */
+static int start_task(Dag *d, DagTask *t, int devnull, double t0) {
+  t->start = now_seconds() - t0;
+
+  job *j = background_job(t->ast->tree);
+  if (!j) {
+    t->end = t->start;
+    t->status = 1;
+    t->state = TASK_FAILED;
+    fprintf(stderr, "dag: %s could not be started\n", t->name);
+    cancel_dependents(d, t);
+    return -1;
+  }
+  j->stdin = devnull;
+  j->is_background = 1;
+
+  t->state = TASK_RUNNING;
+  t->j = j;
+  launch_job(j, 0);
+  return 0;
+}
+
+/* Record how a finished task went and release what waits on it: its
+   dependents become ready on success and are cancelled on failure.
+   Ready tasks are added to the queue at `ready`.  */
+static void finish_task(Dag *d, DagTask *t, double t0, int *ready,
+                        int *ready_tail, int interrupted) {
+  t->end = now_seconds() - t0;
+  t->status = job_status(t->j);
+  free_job(t->j);
+  t->j = NULL;
+
+  if (t->status != 0) {
+    t->state = TASK_FAILED;
+    if (!interrupted)
+      fprintf(stderr, "dag: %s failed with status %d\n", t->name, t->status);
+    cancel_dependents(d, t);
+    return;
+  }
+
+  t->state = TASK_OK;
+  for (int k = 0; k < t->ndependents; k++) {
+    DagTask *dep = &d->tasks[t->dependents[k]];
+    if (--dep->pending == 0 && dep->state == TASK_WAITING)
+      ready[(*ready_tail)++] = t->dependents[k];
+  }
+}
+
+static const char *state_name(TaskState state) {
+  switch (state) {
+  case TASK_OK:
+    return "ok";
+  case TASK_FAILED:
+    return "failed";
+  case TASK_CANCELLED:
+    return "cancelled";
+  default:
+    return "running";
+  }
+}
+
+/* Each task's timings, then the chain of dependencies that took longest:
+   how long the whole graph would take with no limit on jobs.  */
+static void report(Dag *d, int *order, double elapsed, int slots) {
+  int width = 4, last = -1;
+  int counts[TASK_CANCELLED + 1] = {0};
+
+  // The tables below are sized by the task count
+  if (d->count <= 0)
+    return;
+
+  for (int k = 0; k < d->count; k++) {
+    DagTask *t = &d->tasks[order[k]];
+    int n = (int)strlen(t->name);
+    if (n > width)
+      width = n;
+    counts[t->state]++;
+    if (t->state != TASK_OK && t->state != TASK_FAILED)
+      continue;
+
+    t->path = 0;
+    for (int m = 0; m < t->ndeps; m++) {
+      DagTask *dep = &d->tasks[t->deps[m]];
+      if (dep->state == TASK_OK && dep->path > t->path) {
+        t->path = dep->path;
+        t->via = t->deps[m];
+      }
+    }
+    t->path += t->end - t->start;
+    if (last < 0 || t->path > d->tasks[last].path)
+      last = order[k];
+  }
+
+  // Mark the chain, walking back from where it ends
+  char *critical = calloc(d->count, 1);
+  if (!critical) {
+    perror("calloc");
+    exit(1);
+  }
+  int length = 0;
+  for (int i = last; i >= 0; i = d->tasks[i].via, length++)
+    critical[i] = 1;
+
+  fprintf(stderr, "%-*s  %-9s %8s %8s\n", width, "task", "status", "start",
+          "time");
+  for (int i = 0; i < d->count; i++) {
+    DagTask *t = &d->tasks[i];
+    if (t->state != TASK_OK && t->state != TASK_FAILED) {
+      fprintf(stderr, "%-*s  %s\n", width, t->name, state_name(t->state));
+      continue;
+    }
+    fprintf(stderr, "%-*s  %-9s %7.2fs %7.2fs%s\n", width, t->name,
+            state_name(t->state), t->start, t->end - t->start,
+            critical[i] ? " *" : "");
+  }
+
+  fprintf(stderr, "dag: %d tasks, %d ok, %d failed, %d cancelled", d->count,
+          counts[TASK_OK], counts[TASK_FAILED],
+          counts[TASK_CANCELLED]);
+  fprintf(stderr, ", %d at a time, %.2fs\n", slots, elapsed);
+
+  if (last >= 0) {
+    // Written from the first task of the chain on
+    int *chain = malloc(sizeof(int) * length);
+    if (!chain) {
+      perror("malloc");
+      exit(1);
+    }
+    int n = length;
+    for (int i = last; i >= 0; i = d->tasks[i].via)
+      chain[--n] = i;
+    fprintf(stderr, "dag: critical path %.2fs:", d->tasks[last].path);
+    for (int k = 0; k < length; k++) {
+      DagTask *t = &d->tasks[chain[k]];
+      fprintf(stderr, "%s %s (%.2fs)", k ? " ->" : "", t->name,
+              t->end - t->start);
+    }
+    fputc('\n', stderr);
+    free(chain);
+  }
+  free(critical);
+}
+
+static void free_dag(Dag *d) {
+  for (int i = 0; i < d->count; i++) {
+    DagTask *t = &d->tasks[i];
+    for (int k = 0; k < t->ndep_names; k++)
+      free(t->dep_names[k]);
+    if (t->ast)
+      ast_cache_release(t->ast);
+    free(t->dep_names);
+    free(t->deps);
+    free(t->dependents);
+    free(t->name);
+    free(t->command);
+  }
+  free(d->tasks);
+  free(d->buckets);
+}
+
+/* Read the spec from `file`, or stdin when it is NULL.  */
+static int read_spec(Dag *d, const char *file) {
+  FILE *in;
+  if (file) {
+    in = fopen(file, "r");
+  } else {
+    int fd = dup(STDIN_FILENO);
+    in = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!in && fd >= 0)
+      close(fd);
+  }
+  if (!in) {
+    fprintf(stderr, "mu: dag: ");
+    perror(file ? file : "stdin");
+    return 1;
+  }
+
+  char *line = NULL;
+  size_t cap = 0;
+  int lineno = 0, err = 0;
+  while (!err && getline(&line, &cap, in) >= 0)
+    err = parse_line(d, line, ++lineno);
+  free(line);
+  fclose(in);
+  return err;
+}
+
+static void usage(void) { fprintf(stderr, "usage: dag [-j N] [file]\n"); }
+
+/* Exits 0 if every task succeeded, 1 if any failed or was cancelled, 2
+   for a bad spec and 130 if interrupted.  */
+int mu_dag(char **args) {
+  int slots = -1;
+  int i = 1;
+
+  for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+    if (strcmp(args[i], "--") == 0) {
+      i++;
+      break;
+    }
+    if (strncmp(args[i], "-j", 2) == 0) {
+      const char *n = args[i][2] ? args[i] + 2 : args[++i];
+      char *end;
+      if (!n || (slots = (int)strtol(n, &end, 10)) < 0 || *end) {
+        fprintf(stderr, "mu: dag: -j needs a number of jobs\n");
+        return 2;
+      }
+    } else {
+      fprintf(stderr, "mu: dag: %s: invalid option\n", args[i]);
+      usage();
+      return 2;
+    }
+  }
+  const char *file = args[i];
+  if (file && args[i + 1]) {
+    usage();
+    return 2;
+  }
+  if (file && strcmp(file, "-") == 0)
+    file = NULL;
+
+  // -j 0, or none: one per online CPU
+  if (slots <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    slots = cpus > 0 ? (int)cpus : 1;
+  }
+
+  Dag d = {0};
+  int *order = NULL;
+  int err = read_spec(&d, file);
+  if (!err && d.count > 0) {
+    order = malloc(sizeof(int) * d.count);
+    if (!order) {
+      perror("malloc");
+      exit(1);
+    }
+    err = link_tasks(&d, order);
+  }
+  // Every command is parsed before anything runs
+  for (int k = 0; !err && k < d.count; k++) {
+    DagTask *t = &d.tasks[k];
+    if (!(t->ast = ast_cache_acquire(t->command))) {
+      fprintf(stderr, "mu: dag: line %d: %s: cannot parse command\n",
+              t->line, t->name);
+      err = 1;
+    }
+  }
+  if (err || d.count == 0) {
+    free_dag(&d);
+    free(order);
+    return err ? 2 : 0;
+  }
+
+  // Tasks must not read the spec, or the terminal
+  int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  int *ready = malloc(sizeof(int) * d.count);
+  int *running = malloc(sizeof(int) * slots);
+  wait_target *targets = calloc(slots, sizeof(wait_target));
+  if (devnull < 0 || !ready || !running || !targets) {
+    perror("mu: dag");
+    exit(1);
+  }
+
+  // In spec order: the tasks with no dependencies
+  int ready_head = 0, ready_tail = 0;
+  for (int k = 0; k < d.count; k++)
+    if (d.tasks[k].ndeps == 0)
+      ready[ready_tail++] = k;
+
+  fflush(stdout);
+  int count = 0, interrupted = 0;
+  double t0 = now_seconds();
+
+  for (;;) {
+    while (!interrupted && count < slots && ready_head < ready_tail) {
+      int k = ready[ready_head++];
+      if (start_task(&d, &d.tasks[k], devnull, t0) == 0)
+        running[count++] = k;
+    }
+    if (count == 0)
+      break;
+
+    for (int k = 0; k < count; k++)
+      targets[k].j = d.tasks[running[k]].j;
+    if (wait_for_targets(targets, count, 1, -1) == -2 && !interrupted) {
+      // Start nothing more and end what is running
+      interrupted = 1;
+      for (int k = 0; k < d.count; k++)
+        if (d.tasks[k].state == TASK_WAITING)
+          d.tasks[k].state = TASK_CANCELLED;
+      for (int k = 0; k < count; k++)
+        for (process *p = d.tasks[running[k]].j->first_process; p;
+             p = p->next)
+          if (p->pid > 0 && !p->completed)
+            kill(p->pid, SIGTERM);
+    }
+
+    for (int k = count - 1; k >= 0; k--) {
+      DagTask *t = &d.tasks[running[k]];
+      if (!job_is_completed(t->j))
+        continue;
+      finish_task(&d, t, t0, ready, &ready_tail, interrupted);
+      running[k] = running[--count];
+    }
+  }
+
+  report(&d, order, now_seconds() - t0, slots);
+
+  int status = 0;
+  for (int k = 0; k < d.count; k++)
+    if (d.tasks[k].state != TASK_OK)
+      status = 1;
+
+  close(devnull);
+  free(ready);
+  free(running);
+  free(targets);
+  free(order);
+  free_dag(&d);
+  return interrupted ? 130 : status;
+}
@@ -0,0 +1,20 @@
+#ifndef DAG_H
+#define DAG_H
+
+// dag [-j N] [file]
+// Runs a graph of tasks read from the file, or standard input, one per
+// line as
+//
+//   name [dependency...]: command line
+//
+// A task starts once every task it depends on has succeeded, with at
+// most N running at a time, each as a background job started with
+// launch_job(). When a task fails, everything that depends on it,
+// directly or not, is cancelled while the rest carries on. At the end a
+// report on stderr gives each task's start and duration and marks the
+// critical path: the chain of dependencies whose durations add up to the
+// longest time.
+
+int mu_dag(char **args);
+
+#endif
@@ -12,16 +12,27 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "argv.h"
+#include "ast_cache.h"
 #include "builtins.h"
 #include "execute.h"
+#include "expand.h"
 #include "launch.h"
+#include "reaper.h"
+#include "redirect.h"
 #include "substitution.h"
 #include "tokenizer.h"
 #include "job_control.h"
+#include "job_table.h"
 
 extern int debug_substitution;
+extern int mu_last_status;
+
+pid_t mu_last_bg_pid = 0; /* $! */
+int mu_last_bg_status = -1; /* $!'s status once its job is freed */
 
 char *argv_join(char **argv);
+ArgvBuilder *build_argv(ASTNode *node);
 
 int exec_substitute_node(ASTNode *node, int silent) {
   if (debug_substitution) {
@@ -38,7 +49,8 @@ int exec_bang_node(ASTNode *node) {
 }
 
 int exec_sequence_node(ASTNode *node, int silent) {
-  execute(node->left, silent);
+  // $? in the next command sees this one's status
+  mu_last_status = execute(node->left, silent);
   return execute(node->right, silent);
 }
 
@@ -58,86 +70,198 @@ int exec_or_node(ASTNode *node) {
     return status;
 }
 
-int exec_pipe_node(ASTNode *node, int silent) {
-  ASTNode *commands[64];
-  int cmd_count = 0;
-  ASTNode *current = node;
-  while (current && current->type == NODE_PIPE) {
-    commands[cmd_count++] = current->left;
-    current = current->right;
-  }
-  if (current) {
-    commands[cmd_count++] = current;
-  }
+/* Text for a tree, rebuilt for job listings; redirections and the
+   contents of substitutions are left out.  */
+static void describe_node(StrBuf *out, ASTNode *node) {
+  const char *op;
 
-  int pipefds[2 * (cmd_count - 1)];
-  for (int i = 0; i < cmd_count - 1; i++) {
-    if (pipe(pipefds + i * 2) < 0) {
-      if (!silent)
-        perror("pipe");
-      return 1;
+  switch (node->type) {
+  case NODE_COMMAND:
+    for (int i = 0; i < node->argc; i++) {
+      if (i > 0)
+        strbuf_putc(out, ' ');
+      if (node->args[i].is_substitution)
+        strbuf_append(out, "$(...)", 6);
+      else
+        strbuf_append(out, node->args[i].word.text, node->args[i].word.len);
     }
+    return;
+  case NODE_SUBSHELL:
+    strbuf_putc(out, '(');
+    describe_node(out, node->left);
+    strbuf_putc(out, ')');
+    return;
+  case NODE_BANG:
+    strbuf_append(out, "! ", 2);
+    describe_node(out, node->left);
+    return;
+  case NODE_JOB:
+    describe_node(out, node->left);
+    strbuf_append(out, " &", 2);
+    return;
+  case NODE_PIPE:
+    op = " | ";
+    break;
+  case NODE_AND:
+    op = " && ";
+    break;
+  case NODE_OR:
+    op = " || ";
+    break;
+  case NODE_SEQUENCE:
+    op = "; ";
+    break;
+  default:
+    strbuf_append(out, "...", 3);
+    return;
   }
+  describe_node(out, node->left);
+  strbuf_append(out, op, strlen(op));
+  describe_node(out, node->right);
+}
 
-  pid_t pids[cmd_count];
-  for (int i = 0; i < cmd_count; i++) {
-    pids[i] = fork();
-    if (pids[i] < 0) {
-      if (!silent)
-        perror("fork");
-      for (int j = 0; j < 2 * (cmd_count - 1); j++)
-        close(pipefds[j]);
-      return 1;
-    }
+static void describe_stage(StrBuf *out, process *p) {
+  if (!p->node) {
+    char *text = argv_join(p->argv);
+    strbuf_append(out, text, strlen(text));
+    free(text);
+  } else {
+    describe_node(out, p->node);
+  }
+}
 
-    if (pids[i] == 0) {
-      if (i > 0) {
-        if (dup2(pipefds[(i - 1) * 2], STDIN_FILENO) < 0) {
-          if (!silent)
-            perror("dup2 stdin");
-          exit(1);
-        }
-      }
+/* Flatten a pipeline of any length into a job with one process per
+   stage.  The parser nests pipes to the left, a | b | c being
+   ((a | b) | c), so the stages are collected walking down the left
+   side.  Simple commands get their argv and redirection plan now;
+   subshells and other compound stages run in a forked copy of the
+   shell.  */
+job *pipeline_job(ASTNode *node) {
+  job *j = calloc(1, sizeof(job));
+  if (!j) {
+    perror("calloc");
+    return NULL;
+  }
+  j->stdin = STDIN_FILENO;
+  j->stdout = STDOUT_FILENO;
+  j->stderr = STDERR_FILENO;
 
-      if (i < cmd_count - 1) {
-        if (dup2(pipefds[i * 2 + 1], STDOUT_FILENO) < 0) {
-          if (!silent)
-            perror("dup2 stdout");
-          exit(1);
-        }
+  // Built back to front, so each new stage goes on the head of the list
+  ASTNode *n = node;
+  while (n) {
+    ASTNode *stage = n->type == NODE_PIPE ? n->right : n;
+
+    process *p = calloc(1, sizeof(process));
+    if (!p) {
+      perror("calloc");
+      free_job(j);
+      return NULL;
+    }
+    if (stage->type == NODE_COMMAND) {
+      p->argv_owner = build_argv(stage);
+      p->argv = p->argv_owner->argv;
+      // A malformed target has been reported; the stage is not started
+      if (stage->redirs && !(p->redirs = redir_plan_new(stage->redirs))) {
+        p->completed = 1;
+        p->status = 1 << 8;
       }
+    } else {
+      p->node = stage;
+    }
+    p->next = j->first_process;
+    j->first_process = p;
 
-      for (int j = 0; j < 2 * (cmd_count - 1); j++)
-        close(pipefds[j]);
+    n = n->type == NODE_PIPE ? n->left : NULL;
+  }
 
-      int status = execute(commands[i], silent);
-      exit(status);
-    }
+  StrBuf text;
+  strbuf_init(&text);
+  for (process *p = j->first_process; p; p = p->next) {
+    if (p != j->first_process)
+      strbuf_append(&text, " | ", 3);
+    describe_stage(&text, p);
   }
+  j->command = strbuf_detach(&text);
+  return j;
+}
 
-  for (int i = 0; i < 2 * (cmd_count - 1); i++) {
-    close(pipefds[i]);
+/* A job for any tree run with &: a command or pipeline is the usual job
+   of one process per stage; any other list is a single stage run by a
+   forked copy of the shell, which gets a process group of its own.  */
+job *background_job(ASTNode *node) {
+  if (node->type == NODE_COMMAND || node->type == NODE_PIPE)
+    return pipeline_job(node);
+
+  job *j = calloc(1, sizeof(job));
+  process *p = calloc(1, sizeof(process));
+  if (!j || !p) {
+    perror("calloc");
+    free(j);
+    free(p);
+    return NULL;
   }
+  p->node = node;
+  j->first_process = p;
+  j->stdin = STDIN_FILENO;
+  j->stdout = STDOUT_FILENO;
+  j->stderr = STDERR_FILENO;
+
+  StrBuf text;
+  strbuf_init(&text);
+  describe_node(&text, node);
+  j->command = strbuf_detach(&text);
+  return j;
+}
 
-  int status = 0;
-  for (int i = 0; i < cmd_count; i++) {
-    int wstatus;
-    waitpid(pids[i], &wstatus, 0);
-    if (i == cmd_count - 1) {
-      status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 1;
-    }
+/* True if a stage is a builtin command, judged from its first word.
+   Compound stages (subshells, lists) have no argv and never are.  */
+static int stage_is_builtin(process *p) {
+  return p->argv && p->argv[0] && mu_find_builtin(p->argv[0]) >= 0;
+}
+
+/* With `set -o lastpipe`, a last stage that is a builtin other than exec
+   or exit runs in the shell instead of a fork, so its effects (read, cd)
+   stay there.  Only the last: the shell runs its stages after starting
+   the rest, and one writing into a pipe another would drain later could
+   block it for good.  */
+static void mark_shell_stages(job *j) {
+  process *last = j->first_process;
+  while (last->next)
+    last = last->next;
+  if (mu_opt_lastpipe && stage_is_builtin(last) &&
+      strcmp(last->argv[0], "exec") != 0 && strcmp(last->argv[0], "exit") != 0)
+    last->in_shell = 1;
+}
+
+int exec_pipe_node(ASTNode *node, int silent) {
+  job *j = pipeline_job(node);
+  if (!j) {
+    if (!silent)
+      fprintf(stderr, "mu: failed to create job\n");
+    return 1;
   }
-  return status;
+  mark_shell_stages(j);
+  job_table_add(j);
+
+  launch_job(j, 1);
+  return finish_job(j);
 }
 
 int exec_subshell_node(ASTNode *node, int silent) {
-  pid_t pid = fork();
+  // Already alone in a child with nothing left to do: no need for another
+  if (mu_is_child && (node->flags & NODE_EXEC_TAIL))
+    return execute(node->left, silent);
+
+  pid_t pid = mu_fork();
   if (pid == 0) {
+    // Job control stays with the parent shell
+    shell_is_interactive = 0;
     int subshell_status = execute(node->left, silent);
     exit(subshell_status);
   } else if (pid > 0) {
     int status;
-    waitpid(pid, &status, 0);
+    if (reaper_wait_pid(pid, &status) < 0)
+      return 1;
     return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
   } else {
     if (!silent)
@@ -146,112 +270,16 @@ int exec_subshell_node(ASTNode *node, int silent) {
   }
 }
 
-int apply_redirections(ASTNode *node) {
-  Redirection *r = node->redirs;
-  while (r) {
-    int fd_target;
-
-    if (r->filename[0] == '&') {
-      if (r->filename[1] == '-') {
-        if (close(r->fd) == -1) {
-          perror("close");
-          return 1;
-        }
-      } else if (isdigit(r->filename[1])) {
-        int target_fd = atoi(r->filename + 1);
-        if (dup2(target_fd, r->fd) == -1) {
-          perror("dup2");
-          return 1;
-        }
-      } else {
-        fprintf(stderr, "Invalid redirection target: %s\n", r->filename);
-        return 1;
-      }
-      r = r->next;
-      continue;
-    }
-
-    switch (r->type) {
-    case NODE_READ:
-      fd_target = O_RDONLY;
-      break;
-    case NODE_WRITE:
-      fd_target = O_WRONLY | O_CREAT | O_TRUNC;
-      break;
-    case NODE_APPEND:
-      fd_target = O_WRONLY | O_CREAT | O_APPEND;
-      break;
-    case NODE_READWRITE:
-      fd_target = O_RDWR | O_CREAT;
-      break;
-    case NODE_ERR:
-      fd_target = O_WRONLY | O_CREAT | O_TRUNC;
-      break;
-    case NODE_WRITE_ERR:
-      fd_target = O_WRONLY | O_CREAT | O_TRUNC;
-      break;
-    default:
-      fprintf(stderr, "Unknown redirection type\n");
-      return 1;
-    }
-
-    int fd = open(r->filename, fd_target, 0644);
-    if (fd == -1) {
-      perror(r->filename);
-      return 1;
-    }
-
-    if (dup2(fd, r->fd) == -1) {
-      perror("dup2");
-      close(fd);
-      return 1;
-    }
-
-    close(fd);
-    r = r->next;
-  }
-  return 0;
-}
-
 int exec_command_node(ASTNode *node) {
   if (debug_substitution) {
     fprintf(stderr, "DEBUG execute: Processing NODE_COMMAND with %d args\n",
             node->argc);
   }
 
-  // Save original FDs
-  int saved_stdin = dup(STDIN_FILENO);
-  int saved_stdout = dup(STDOUT_FILENO);
-  int saved_stderr = dup(STDERR_FILENO);
-
-  int status = 0;
-  if (apply_redirections(node) == 1) {
-    status = 1;
-    goto cleanup_fds;
-  }
-
-  char **argv = malloc(sizeof(char *) * (node->argc + 64));
-  int argc = 0;
-
-  for (int i = 0; i < node->argc; i++) {
-    if (node->args[i].is_substitution) {
-      char *output = execute_substitution(node->args[i].substitution_node);
-
-      if (output && *output) {
-        char *saveptr = NULL;
-        char *token = strtok_r(output, " \t\r\n", &saveptr);
-        while (token != NULL) {
-          argv[argc++] = strdup(token);
-          token = strtok_r(NULL, " \t\r\n", &saveptr);
-        }
-      }
-      free(output);
-    } else {
-      char *processed = process_quotes(node->args[i].text);
-      argv[argc++] = processed;
-    }
-  }
-  argv[argc] = NULL;
+  // Words are expanded, and substitutions run, before any redirection
+  ArgvBuilder *args = build_argv(node);
+  char **argv = args->argv;
+  int argc = args->argc;
 
   if (debug_substitution) {
     fprintf(stderr, "DEBUG execute: Final argv has %d elements:\n", argc);
@@ -261,92 +289,113 @@ int exec_command_node(ASTNode *node) {
     fprintf(stderr, "DEBUG execute: argv[%d] = NULL\n", argc);
   }
 
-  // Check if it's a builtin command - handle directly without job control
-  if (argv[0]) {
-    for (int i = 0; i < mu_num_builtins(); i++) {
-      if (strcmp(argv[0], builtin_str[i]) == 0) {
-        status = (*builtin_func[i])(argv);
-        goto cleanup_argv;
-      }
+  int status = 0;
+  RedirPlan *redirs = NULL;
+  if (node->redirs) {
+    redirs = redir_plan_new(node->redirs);
+    if (!redirs || redir_plan_open(redirs)) {
+      status = 1;
+      goto cleanup;
     }
   }
 
+  // Nothing left to run: a command that was only substitutions takes
+  // the status of the last one.  Its files have been created by now.
+  if (!argv[0]) {
+    status = args->subst_status;
+    goto cleanup;
+  }
+
+  // Builtins run here, with only the descriptors they redirect saved
+  int builtin = mu_find_builtin(argv[0]);
+  if (builtin >= 0) {
+    status = mu_run_builtin(builtin, argv, redirs);
+    goto cleanup;
+  }
+
+  // Too big for execve: say so now rather than failing in the child
+  if (argv_check_size(args)) {
+    status = 126;
+    goto cleanup;
+  }
+
+  // Last command of a forked child: become the command instead of forking
+  if (mu_is_child && (node->flags & NODE_EXEC_TAIL)) {
+    if (redirs && redir_plan_apply(redirs, 0))
+      exit(1);
+    mu_exec_tail(argv);
+  }
+
   // Create job for non-builtin commands
-  if (argv[0] && shell_is_interactive) {
+  if (shell_is_interactive) {
     job *j = calloc(1, sizeof(job));
     j->stdin = STDIN_FILENO;
     j->stdout = STDOUT_FILENO;
     j->stderr = STDERR_FILENO;
     j->pgid = 0;
     j->notified = 0;
-    j->next = first_job;
-    first_job = j;
 
-    // Create process
+    // Create process; the job owns argv and the plan from here on
     process *p = calloc(1, sizeof(process));
-    p->argv = argv; // Transfer ownership
+    p->argv = argv;
+    p->argv_owner = args;
+    p->redirs = redirs;
     p->next = NULL;
     j->first_process = p;
-    j->command = strdup(argv_join(argv));
+    j->command = argv_join(argv);
+    job_table_add(j);
 
     launch_job(j, 1); // 1 = foreground
-    status = j->first_process->status;
-    
-    // Don't free argv here since job owns it now
-    goto cleanup_fds;
-  } else {
-    // Non-interactive mode or no command
-    status = mu_execute(argv);
+    return finish_job(j);
   }
 
-cleanup_argv:
-  for (int i = 0; i < argc; i++)
-    free(argv[i]);
-  free(argv);
-
-cleanup_fds:
-  dup2(saved_stdin, STDIN_FILENO);
-  dup2(saved_stdout, STDOUT_FILENO);
-  dup2(saved_stderr, STDERR_FILENO);
-  close(saved_stdin);
-  close(saved_stdout);
-  close(saved_stderr);
+  status = mu_execute(argv, redirs);
 
+cleanup:
+  redir_plan_free(redirs);
+  argv_free(args);
   return status;
 }
 
-char **ast_to_argv(ASTNode *node) {
-    if (!node || node->type != NODE_COMMAND)
-        return NULL;
-
-    char **argv = calloc(node->argc + 64, sizeof(char *));
-    if (!argv) return NULL;
-
-    int argc = 0;
-    
+/* Expand a command's words into an argument vector.  Command
+   substitutions are all run first, concurrently, and their output is
+   split on $IFS while it is read; the fields go in in argument order.  */
+ArgvBuilder *build_argv(ASTNode *node) {
+  ArgvBuilder *args = argv_new();
+
+  int subst_count = 0;
+  for (int i = 0; i < node->argc; i++)
+    if (node->args[i].is_substitution)
+      subst_count++;
+
+  FieldSplitter *outputs = NULL;
+  if (subst_count > 0) {
+    ASTNode **nodes = malloc(sizeof(ASTNode *) * subst_count);
+    outputs = malloc(sizeof(FieldSplitter) * subst_count);
+    if (!nodes || !outputs) {
+      perror("malloc");
+      exit(1);
+    }
+    int n = 0;
     for (int i = 0; i < node->argc; i++) {
-        if (node->args[i].is_substitution) {
-            char *output = execute_substitution(node->args[i].substitution_node);
-            
-            if (output && *output) {
-                char *saveptr = NULL;
-                char *token = strtok_r(output, " \t\r\n", &saveptr);
-                while (token != NULL) {
-                    argv[argc++] = strdup(token);
-                    token = strtok_r(NULL, " \t\r\n", &saveptr);
-                }
-            }
-            free(output);
-        } else {
-            char *processed = process_quotes(node->args[i].text);
-            argv[argc++] = processed;
-        }
+      if (node->args[i].is_substitution) {
+        splitter_init(&outputs[n], args);
+        nodes[n++] = node->args[i].substitution_node;
+      }
     }
-    argv[argc] = NULL;
-    
-    // Reallocate to exact size to save memory
-    char **final_argv = realloc(argv, (argc + 1) * sizeof(char *));
-    return final_argv ? final_argv : argv;
+    args->subst_status = execute_substitutions(nodes, outputs, subst_count);
+    free(nodes);
+  }
+
+  int next = 0;
+  for (int i = 0; i < node->argc; i++) {
+    if (node->args[i].is_substitution)
+      argv_add_fields(args, &outputs[next++]);
+    else
+      argv_add_word(args, &node->args[i].word);
+  }
+  free(outputs);
+  return args;
 }
 
 char *argv_join(char **argv) {
@@ -377,69 +426,129 @@ job *create_job_from_ast(ASTNode *node) {
     j->stderr = STDERR_FILENO;
     j->pgid = 0;
     j->notified = 0;
-    j->next = first_job;
-    first_job = j;
 
     // Convert AST command to process list
     process *p = calloc(1, sizeof(process));
-    p->argv = ast_to_argv(node); // reuse your exec_command_node logic
+    p->argv_owner = build_argv(node);
+    p->argv = p->argv_owner->argv;
     p->next = NULL;
 
     j->first_process = p;
 
     // Optional: store raw command string for user messages
-    j->command = strdup(argv_join(p->argv));
+    j->command = argv_join(p->argv);
+    job_table_add(j);
 
     return j;
 }
 
 int exec_job_node(ASTNode *node, int silent) {
-    if (!shell_is_interactive) {
-        return execute(node->left, silent);
-    }
-
-    job *j = calloc(1, sizeof(job));
+    job *j = background_job(node->left);
     if (!j) {
         if (!silent) fprintf(stderr, "mu: failed to create job\n");
         return 1;
     }
-    
-    j->stdin = STDIN_FILENO;
-    j->stdout = STDOUT_FILENO;
-    j->stderr = STDERR_FILENO;
-    j->pgid = 0;
-    j->notified = 0;
+
     j->is_background = 1;  // Mark as background job
-    j->next = first_job;
-    first_job = j;
+    job_table_add(j);
 
-    process *p = calloc(1, sizeof(process));
-    if (!p) {
-        free(j);
-        if (!silent) fprintf(stderr, "mu: failed to create process\n");
-        return 1;
-    }
-    
-    p->argv = ast_to_argv(node->left);
-    if (!p->argv) {
-        free(p);
-        free(j);
-        if (!silent) fprintf(stderr, "mu: failed to create argv\n");
-        return 1;
+    // Without job control it would share the terminal: POSIX gives it
+    // /dev/null as its standard input instead
+    if (!shell_is_interactive) {
+        int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (devnull >= 0)
+            j->stdin = devnull;
     }
-    
-    p->next = NULL;
-    p->completed = 0;
-    p->stopped = 0;
-    p->pid = 0;
-
-    j->first_process = p;
-    j->command = argv_join(p->argv);
 
     launch_job(j, 0); // 0 = background
+    if (shell_is_interactive)
+        format_job_info(j, "launched");
+
+    if (j->stdin != STDIN_FILENO) {
+        close(j->stdin);
+        j->stdin = STDIN_FILENO;
+    }
+
+    // $! is the last process of the pipeline
+    process *last = j->first_process;
+    while (last->next)
+        last = last->next;
+    if (last->pid > 0) {
+        mu_last_bg_pid = last->pid;
+        mu_last_bg_status = -1;
+    }
     return 0;
 }
 
+/* Mark the nodes that are the last thing run by the process executing
+   them: a command there can exec directly and a subshell needs no fork of
+   its own.  */
+static void mark_tail(ASTNode *node) {
+  if (!node)
+    return;
+
+  switch (node->type) {
+  case NODE_COMMAND:
+    node->flags |= NODE_EXEC_TAIL;
+    break;
+  case NODE_SEQUENCE:
+  case NODE_AND:
+  case NODE_OR:
+    mark_tail(node->right);
+    break;
+  case NODE_SUBSHELL:
+    node->flags |= NODE_EXEC_TAIL;
+    mark_tail(node->left);
+    break;
+  case NODE_SUBSTITUTE:
+    mark_tail(node->left);
+    break;
+  default:
+    // Negation and background jobs need the shell after the command
+    break;
+  }
+}
+
+/* Fork-elision pass, run once per parsed tree.  Subshell bodies, pipeline
+   stages and command substitutions always run in a child of their own,
+   so their tails can replace that child.  */
+void mark_exec_tails(ASTNode *node) {
+  if (!node)
+    return;
+
+  switch (node->type) {
+  case NODE_SUBSHELL:
+    mark_tail(node->left);
+    break;
+  case NODE_JOB:
+    // A list run with & has a child to itself; a command or pipeline is
+    // launched stage by stage instead
+    if (node->left->type != NODE_COMMAND && node->left->type != NODE_PIPE)
+      mark_tail(node->left);
+    break;
+  case NODE_PIPE:
+    // Every stage that isn't itself a pipe is a tail
+    if (node->left->type != NODE_PIPE)
+      mark_tail(node->left);
+    if (node->right->type != NODE_PIPE)
+      mark_tail(node->right);
+    break;
+  case NODE_COMMAND:
+    for (int i = 0; i < node->argc; i++) {
+      if (node->args[i].is_substitution) {
+        mark_tail(node->args[i].substitution_node);
+        mark_exec_tails(node->args[i].substitution_node);
+      }
+    }
+    break;
+  default:
+    break;
+  }
+
+  mark_exec_tails(node->left);
+  mark_exec_tails(node->right);
+}
+
 int execute(ASTNode *node, int silent) {
   if (!node) {
     if (debug_substitution) {
@@ -460,7 +569,7 @@ int execute(ASTNode *node, int silent) {
   case NODE_OR:
     return exec_or_node(node);
   case NODE_SEQUENCE:
-    return exec_subshell_node(node, silent);
+    return exec_sequence_node(node, silent);
   case NODE_SUBSHELL:
     return exec_subshell_node(node, silent);
   case NODE_PIPE:
@@ -480,14 +589,26 @@ int execute(ASTNode *node, int silent) {
 }
 
 int mu_execute_logical_commands(char *line) {
-  tokenize(line);
-  ASTNode *tree = parse_sequence();
+  // Parsed trees are cached by line text; expansion happens during
+  // execution, so a cached tree is safe to run again as-is.
+  AstCacheEntry *entry = ast_cache_acquire(line);
 
-  // print_ast(tree, 0);
-  if (!tree) {
+  if (!entry) {
     fprintf(stderr, "mu: parse error\n");
     return 1;
   }
 
-  return execute(tree, 0);
+  mu_fork_count_reset();
+
+  // print_ast(entry->tree, 0);
+  int status = execute(entry->tree, 0);
+
+  if (debug_substitution) {
+    arena_report(&entry->arena, "line");
+    ast_cache_report();
+    fprintf(stderr, "DEBUG forks: %lu, spawns: %lu\n", mu_fork_count(),
+            mu_spawn_count());
+  }
+  ast_cache_release(entry);
+  return status;
 }
@@ -2,8 +2,11 @@
 #define EXECUTE_H
 
 #import "tokenizer.h"
+#include "job.h"
 
+void mark_exec_tails(ASTNode *node);
 int execute(ASTNode *node, int silent);
+job *background_job(ASTNode *node);
 int mu_execute_logical_commands(char *line);
 
 #endif
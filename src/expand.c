@@ -0,0 +1,292 @@
+#include <ctype.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "expand.h"
+#include "tokenizer.h"
+
+extern int mu_last_status;
+extern pid_t mu_last_bg_pid;
+extern pid_t shell_pid;
+
+// $0 and the script arguments, set by mu_set_positional()
+static char **positional = NULL;
+static int positional_count = 0;
+
+void mu_set_positional(int argc, char **argv) {
+  positional = argv;
+  positional_count = argc;
+}
+
+void strbuf_init(StrBuf *b) {
+  b->data = NULL;
+  b->len = 0;
+  b->cap = 0;
+}
+
+/* Make room for `extra` more bytes plus the terminating NUL.  */
+void strbuf_reserve(StrBuf *b, size_t extra) {
+  if (b->len + extra + 1 <= b->cap)
+    return;
+
+  size_t cap = b->cap ? b->cap : 32;
+  while (cap < b->len + extra + 1)
+    cap *= 2;
+
+  char *data = realloc(b->data, cap);
+  if (!data) {
+    perror("realloc");
+    exit(1);
+  }
+  b->data = data;
+  b->cap = cap;
+  b->data[b->len] = '\0';
+}
+
+void strbuf_putc(StrBuf *b, char c) {
+  strbuf_reserve(b, 1);
+  b->data[b->len++] = c;
+  b->data[b->len] = '\0';
+}
+
+void strbuf_append(StrBuf *b, const char *s, size_t n) {
+  strbuf_reserve(b, n);
+  memcpy(b->data + b->len, s, n);
+  b->len += n;
+  b->data[b->len] = '\0';
+}
+
+/* Empty the buffer but keep its memory for the next word.  */
+void strbuf_reset(StrBuf *b) {
+  b->len = 0;
+  if (b->data)
+    b->data[0] = '\0';
+}
+
+void strbuf_free(StrBuf *b) {
+  free(b->data);
+  strbuf_init(b);
+}
+
+/* Hand the contents to the caller, who must free() them.  */
+char *strbuf_detach(StrBuf *b) {
+  strbuf_reserve(b, 0);
+  char *data = b->data;
+  strbuf_init(b);
+  return data;
+}
+
+static void append_number(StrBuf *out, long n) {
+  char num[24];
+  int len = snprintf(num, sizeof(num), "%ld", n);
+  strbuf_append(out, num, len);
+}
+
+// $0, $1 ... ${10}; unset parameters expand to nothing
+static void append_positional(StrBuf *out, const char *digits, size_t len) {
+  long n = 0;
+  for (size_t i = 0; i < len; i++) {
+    n = n * 10 + (digits[i] - '0');
+    if (n >= positional_count)
+      return;
+  }
+  strbuf_append(out, positional[n], strlen(positional[n]));
+}
+
+// $@ and $* both join the arguments with spaces into one word
+static void append_all_positional(StrBuf *out) {
+  for (int i = 1; i < positional_count; i++) {
+    if (i > 1)
+      strbuf_putc(out, ' ');
+    strbuf_append(out, positional[i], strlen(positional[i]));
+  }
+}
+
+static void append_variable(StrBuf *out, const char *name, size_t len) {
+  char small[256];
+  char *key = small;
+
+  if (len >= sizeof(small))
+    key = strndup(name, len);
+  else {
+    memcpy(small, name, len);
+    small[len] = '\0';
+  }
+
+  // Unset variables expand to nothing
+  const char *value = getenv(key);
+  if (value)
+    strbuf_append(out, value, strlen(value));
+
+  if (key != small)
+    free(key);
+}
+
+/* Expand the parameter whose name starts at src[i], just past a '$'.
+   Returns the index of the first byte after the expansion.  */
+static size_t expand_dollar(const char *src, size_t len, size_t i,
+                            StrBuf *out) {
+  char c = src[i];
+
+  if (c == '{') {
+    size_t end = i + 1;
+    while (end < len && src[end] != '}')
+      end++;
+    if (end == len) {
+      // No closing brace: keep the text literally
+      strbuf_putc(out, '$');
+      return i;
+    }
+    const char *name = src + i + 1;
+    size_t name_len = end - (i + 1);
+    if (name_len == 1 && (*name == '?' || *name == '$' || *name == '!' ||
+                          *name == '#' || *name == '@' || *name == '*'))
+      expand_dollar(name, name_len, 0, out);
+    else if (name_len > 0 && isdigit((unsigned char)*name))
+      append_positional(out, name, name_len);
+    else
+      append_variable(out, name, name_len);
+    return end + 1;
+  }
+
+  if (c == '?') {
+    append_number(out, mu_last_status);
+    return i + 1;
+  }
+
+  if (c == '$') {
+    append_number(out, (long)shell_pid);
+    return i + 1;
+  }
+
+  if (c == '!') {
+    // Empty until something has been started in the background
+    if (mu_last_bg_pid > 0)
+      append_number(out, (long)mu_last_bg_pid);
+    return i + 1;
+  }
+
+  if (isalpha((unsigned char)c) || c == '_') {
+    size_t start = i;
+    while (i < len && (isalnum((unsigned char)src[i]) || src[i] == '_'))
+      i++;
+    append_variable(out, src + start, i - start);
+    return i;
+  }
+
+  if (c == '#') {
+    append_number(out, positional_count > 0 ? positional_count - 1 : 0);
+    return i + 1;
+  }
+
+  if (c == '@' || c == '*') {
+    append_all_positional(out);
+    return i + 1;
+  }
+
+  if (isdigit((unsigned char)c)) {
+    // Only one digit without braces: $10 is ${1}0
+    append_positional(out, src + i, 1);
+    return i + 1;
+  }
+
+  // Just a $ followed by something else - treat as literal
+  strbuf_putc(out, '$');
+  return i;
+}
+
+/* Expand a leading ~ or ~user.  Returns the number of source bytes
+   consumed, or 0 if the prefix is quoted or names no known user.  */
+static size_t expand_tilde_prefix(const char *src, size_t len, StrBuf *out) {
+  size_t end = 1;
+  while (end < len && src[end] != '/') {
+    if (src[end] == '\'' || src[end] == '"' || src[end] == '\\' ||
+        src[end] == '$')
+      return 0;
+    end++;
+  }
+
+  const char *dir = NULL;
+  if (end == 1) {
+    dir = getenv("HOME");
+    if (!dir) {
+      struct passwd *pw = getpwuid(getuid());
+      dir = pw ? pw->pw_dir : NULL;
+    }
+  } else {
+    char user[256];
+    if (end - 1 >= sizeof(user))
+      return 0;
+    memcpy(user, src + 1, end - 1);
+    user[end - 1] = '\0';
+    struct passwd *pw = getpwnam(user);
+    dir = pw ? pw->pw_dir : NULL;
+  }
+
+  if (!dir)
+    return 0;
+  strbuf_append(out, dir, strlen(dir));
+  return end;
+}
+
+/* Expand one word in a single pass: tilde prefix, quote removal, escapes
+   and $VAR, ${VAR}, $?, $$, $# and positional parameters.  The result is
+   appended to `out`.  */
+void expand_word_into(const char *src, size_t len, StrBuf *out) {
+  size_t i = 0;
+  int in_double_quote = 0;
+
+  strbuf_reserve(out, len);
+
+  if (len > 0 && src[0] == '~')
+    i = expand_tilde_prefix(src, len, out);
+
+  while (i < len) {
+    char c = src[i];
+
+    if (c == '\'' && !in_double_quote) {
+      // Single quotes: everything literal until the closing quote
+      size_t end = i + 1;
+      while (end < len && src[end] != '\'')
+        end++;
+      strbuf_append(out, src + i + 1, end - (i + 1));
+      i = end < len ? end + 1 : end;
+    } else if (c == '"') {
+      in_double_quote = !in_double_quote;
+      i++;
+    } else if (c == '\\' && i + 1 < len) {
+      char next = src[i + 1];
+      if (!in_double_quote || next == '"' || next == '\\' || next == '$' ||
+          next == '`' || next == '\n') {
+        // Backslash-newline is a line continuation and vanishes
+        if (next != '\n')
+          strbuf_putc(out, next);
+        i += 2;
+      } else {
+        strbuf_putc(out, c);
+        i++;
+      }
+    } else if (c == '$' && i + 1 < len) {
+      i = expand_dollar(src, len, i + 1, out);
+    } else {
+      strbuf_putc(out, c);
+      i++;
+    }
+  }
+}
+
+/* Expand a word into a newly allocated string.  Words without quotes,
+   escapes or expansions are copied as they are.  */
+char *expand_word(const Word *word) {
+  if (!(word->flags & (WORD_QUOTED | WORD_ESCAPED | WORD_DOLLAR | WORD_TILDE)))
+    return strndup(word->text, word->len);
+
+  StrBuf out;
+  strbuf_init(&out);
+  expand_word_into(word->text, word->len, &out);
+  return strbuf_detach(&out);
+}
@@ -0,0 +1,27 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stddef.h>
+
+#include "tokenizer.h"
+
+// Growable output buffer; `data` is always NUL-terminated once allocated
+typedef struct StrBuf {
+  char *data;
+  size_t len;
+  size_t cap;
+} StrBuf;
+
+void strbuf_init(StrBuf *b);
+void strbuf_reserve(StrBuf *b, size_t extra);
+void strbuf_putc(StrBuf *b, char c);
+void strbuf_append(StrBuf *b, const char *s, size_t n);
+void strbuf_reset(StrBuf *b);
+void strbuf_free(StrBuf *b);
+char *strbuf_detach(StrBuf *b);
+
+void mu_set_positional(int argc, char **argv);
+void expand_word_into(const char *src, size_t len, StrBuf *out);
+char *expand_word(const Word *word);
+
+#endif
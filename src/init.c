@@ -5,21 +5,27 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include "reaper.h"
 #include "signal_handlers.h"
 
 extern pid_t shell_pgid;
+extern pid_t shell_pid;
 extern struct termios shell_tmodes;
 extern int shell_terminal;
 extern int shell_is_interactive;
 
 /* Make sure the shell is running interactively as the foreground job
-   before proceeding. */
+   before proceeding.  Scripts pass interactive = 0 and never take the
+   terminal. */
 
-void mu_init() {
+void mu_init(int interactive) {
+
+  /* Forked children expand words too; $$ stays the shell's pid.  */
+  shell_pid = getpid();
 
   /* See if we are running interactively.  */
   shell_terminal = STDIN_FILENO;
-  shell_is_interactive = isatty(shell_terminal);
+  shell_is_interactive = interactive && isatty(shell_terminal);
 
   if (shell_is_interactive) {
     /* Loop until we are in the foreground.  */
@@ -33,7 +39,8 @@ void mu_init() {
     signal(SIGTTIN, SIG_IGN);
     signal(SIGTTOU, SIG_IGN);
 
-    signal(SIGCHLD, sigchld_handler);
+    /* SIGCHLD is blocked and read by the reaper.  */
+    reaper_init();
 
     /* Put ourselves in our own process group.  */
     shell_pgid = getpid();
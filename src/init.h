@@ -5,11 +5,12 @@
 #include <termios.h>
 
 pid_t shell_pgid;
+pid_t shell_pid;  /* $$: the shell's own pid, also in subshells */
 struct termios shell_tmodes;
 int shell_terminal;
 int shell_is_interactive;
 
-void mu_init();
+void mu_init(int interactive);
 void restore_terminal_control();
 
 #endif /* ifndef  */
@@ -7,7 +7,7 @@
 #include "process.h"
 
 typedef struct job {
-  struct job *next;          /* next active job */
+  int id;                    /* job number, as in %1; kept while it lives */
   char *command;             /* command line, used for messages */
   process *first_process;    /* list of processes in this job */
   pid_t pgid;                /* process group ID */
@@ -15,6 +15,13 @@ typedef struct job {
   char is_background;        /* true if this is a background job */
   struct termios tmodes;     /* saved terminal modes */
   int stdin, stdout, stderr; /* standard i/o channels */
+
+  /* Links kept by the job table.  */
+  struct job *pgid_next;     /* next job in the same pgid bucket */
+  struct job *name_next;     /* next job in the same command name bucket */
+  struct job *newer, *older; /* by when last made current: %+ first */
+  struct job *changed_prev, *changed_next; /* waiting to be reported */
+  char changed;              /* on the list of jobs to report */
 } job;
 
 #endif
@@ -1,34 +1,41 @@
+#define _GNU_SOURCE /* pipe2 */
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <stdlib.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "argv.h"
+#include "builtins.h"
+#include "cmdhash.h"
+#include "execute.h"
 #include "job.h"
 #include "job_control.h"
+#include "job_table.h"
+#include "launch.h"
 #include "process.h"
-
-job *first_job = NULL;
+#include "reaper.h"
+#include "redirect.h"
+#include "signal_handlers.h"
 
 extern pid_t shell_pgid;
 extern struct termios shell_tmodes;
 extern int shell_is_interactive;
 extern int shell_terminal;
+extern pid_t mu_last_bg_pid;
+extern int mu_last_bg_status;
 
 /* Find the active job with the indicated pgid.  */
-job *find_job(pid_t pgid) {
-  job *j;
-
-  for (j = first_job; j; j = j->next)
-    if (j->pgid == pgid)
-      return j;
-  return NULL;
-}
+job *find_job(pid_t pgid) { return job_table_find_pgid(pgid); }
 
 /* Return true if all processes in the job have stopped or completed.  */
 int job_is_stopped(job *j) {
@@ -51,17 +58,27 @@ int job_is_completed(job *j) {
 }
 
 void free_job(job *j) {
+  job_table_remove(j);
+
   process *p = j->first_process;
   while (p) {
     process *next = p->next;
 
     // Free the argument vector
-    if (p->argv) {
+    if (p->argv_owner) {
+      argv_free(p->argv_owner);
+    } else if (p->argv) {
       for (int i = 0; p->argv[i]; i++)
         free(p->argv[i]);
       free(p->argv);
     }
 
+    if (p->pid > 0 && !p->completed)
+      reaper_untrack(p->pid);
+    // `wait $!` still has a status to give once the job is gone
+    if (p->pid > 0 && p->pid == mu_last_bg_pid && p->completed)
+      mu_last_bg_status = process_status(p);
+    redir_plan_free(p->redirs);
     free(p);
     p = next;
   }
@@ -110,11 +127,105 @@ void launch_process(process *p, pid_t pgid, int infile, int outfile,
     dup2(errfile, STDERR_FILENO);
     close(errfile);
   }
+  if (p->redirs && redir_plan_apply(p->redirs, 0))
+    exit(1);
+
+  /* Stages that aren't a plain external command run in this copy of
+     the shell.  Job control stays with the parent.  */
+  if (p->node) {
+    shell_is_interactive = 0;
+    exit(execute(p->node, 0));
+  }
+  if (!p->argv[0])
+    exit(0);
+  int builtin = mu_find_builtin(p->argv[0]);
+  if (builtin >= 0) {
+    int status = (*builtin_func[builtin])(p->argv);
+    fflush(stdout);
+    exit(status);
+  }
 
   /* Exec the new process.  Make sure we exit.  */
-  execvp(p->argv[0], p->argv);
-  perror("execvp");
-  exit(1);
+  cmdhash_exec(p->argv);
+  int err = errno;
+  perror("mu");
+  exit(err == ENOENT ? 127 : 126);
+}
+
+/* True if p can be started by posix_spawn: an external command with
+   nothing for a copy of the shell to do first.  */
+static int can_spawn_process(process *p, int foreground) {
+  return !p->node && p->argv[0] && mu_find_builtin(p->argv[0]) < 0 &&
+         mu_can_spawn(foreground);
+}
+
+/* A child must not keep the pipe ends of stages the shell runs itself,
+   or their readers would never see EOF.  */
+static void close_shell_stage_fds(job *j, process *upto) {
+  for (process *q = j->first_process; q != upto; q = q->next) {
+    if (!q->in_shell)
+      continue;
+    if (q->infd != j->stdin)
+      close(q->infd);
+    if (q->outfd != j->stdout)
+      close(q->outfd);
+  }
+}
+
+/* Run a pipeline stage inside the shell with its stdin/stdout rebound
+   to the stage's pipe ends for the duration.  */
+static void run_in_shell(process *p) {
+  int saved_in = -1, saved_out = -1;
+
+  /* A reader that has gone away must not kill the shell.  */
+  void (*old_sigpipe)(int) = signal(SIGPIPE, SIG_IGN);
+
+  fflush(stdout);
+  if (p->infd != STDIN_FILENO) {
+    saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(p->infd, STDIN_FILENO);
+    close(p->infd);
+  }
+  if (p->outfd != STDOUT_FILENO) {
+    saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(p->outfd, STDOUT_FILENO);
+    close(p->outfd);
+  }
+
+  int status;
+  if (p->completed)
+    status = WEXITSTATUS(p->status);
+  else if (p->node)
+    status = execute(p->node, 0);
+  else if (p->redirs && redir_plan_open(p->redirs))
+    status = 1;
+  else
+    status = mu_run_builtin(mu_find_builtin(p->argv[0]), p->argv, p->redirs);
+  if (p->redirs)
+    redir_plan_close(p->redirs);
+
+  /* Flush while stdout is still the pipe, then close our end of it so
+     the next stage sees EOF.  */
+  fflush(stdout);
+  if (saved_in >= 0) {
+    dup2(saved_in, STDIN_FILENO);
+    close(saved_in);
+  }
+  if (saved_out >= 0) {
+    dup2(saved_out, STDOUT_FILENO);
+    close(saved_out);
+  }
+  signal(SIGPIPE, old_sigpipe);
+
+  p->completed = 1;
+  p->status = (status & 0xff) << 8;
+}
+
+/* Record that p was never started, with the status a child would have
+   exited with.  */
+static void mark_not_started(process *p, int code) {
+  p->completed = 1;
+  p->status = code << 8;
 }
 
 void launch_job(job *j, int foreground) {
@@ -122,38 +233,93 @@ void launch_job(job *j, int foreground) {
   pid_t pid;
   int mypipe[2], infile, outfile;
 
+  /* The modes fg gives the terminal until the job is first stopped and
+     its own are saved.  */
+  if (shell_is_interactive)
+    j->tmodes = shell_tmodes;
+
+  /* Pipes are made one stage at a time, so at most the read end from the
+     previous stage and the current pair are open.  */
   infile = j->stdin;
   for (p = j->first_process; p; p = p->next) {
-    /* Set up pipes, if necessary.  */
+    /* Set up pipes, if necessary.  Close-on-exec keeps the read end for
+       the next process out of this one; dup2 clears it on fds 0-2.  */
+    mypipe[0] = -1;
     if (p->next) {
-      if (pipe(mypipe) < 0) {
-        perror("pipe");
-        exit(1);
+      if (pipe2(mypipe, O_CLOEXEC) < 0) {
+        perror("mu: pipe");
+        /* Start nothing more; what is running sees EOF.  */
+        for (; p; p = p->next) {
+          p->in_shell = 0;
+          mark_not_started(p, 1);
+        }
+        if (infile != j->stdin)
+          close(infile);
+        break;
       }
       outfile = mypipe[1];
     } else
       outfile = j->stdout;
 
-    /* Fork the child processes.  */
-    pid = fork();
-    if (pid == 0)
-      /* This is the child process.  */
-      launch_process(p, j->pgid, infile, outfile, j->stderr, foreground);
-    else if (pid < 0) {
-      /* The fork failed.  */
-      perror("fork");
-      exit(1);
+    if (p->in_shell) {
+      /* Run after everything else has started; keep its fds until then */
+      p->infd = infile;
+      p->outfd = outfile;
+      infile = mypipe[0];
+      continue;
+    }
+
+    if (p->completed) {
+      /* Failed while the job was built; the error has been shown.  */
+    } else if (p->argv_owner && p->argv[0] && argv_check_size(p->argv_owner)) {
+      mark_not_started(p, 126);
+    } else if (p->redirs && redir_plan_open(p->redirs)) {
+      mark_not_started(p, 1);
+    } else if (can_spawn_process(p, foreground)) {
+      /* Spawn the child processes where possible, fork otherwise.  */
+      pid = mu_spawn(p->argv, j->pgid, foreground, infile, outfile, j->stderr,
+                     p->redirs);
+      if (pid < 0) {
+        /* The command could not be started; it counts as having exited
+           the way a failed exec in a forked child would.  */
+        int err = errno;
+        fprintf(stderr, "mu: %s: %s\n", p->argv[0], strerror(err));
+        mark_not_started(p, err == ENOENT ? 127 : 126);
+      } else {
+        job_table_set_pid(p, pid);
+        reaper_track(pid, p);
+        if (shell_is_interactive && !j->pgid)
+          job_table_set_pgid(j, pid);
+      }
     } else {
-      /* This is the parent process.  */
-      p->pid = pid;
-      if (shell_is_interactive) {
-        if (!j->pgid)
-          j->pgid = pid;
-        setpgid(pid, j->pgid);
+      /* Resolve in the shell so the hash table outlives the child.  */
+      if (!p->node && p->argv[0])
+        cmdhash_lookup(p->argv[0]);
+
+      pid = mu_fork();
+      if (pid == 0) {
+        /* This is the child process.  */
+        close_shell_stage_fds(j, p);
+        launch_process(p, j->pgid, infile, outfile, j->stderr, foreground);
+      } else if (pid < 0) {
+        /* The fork failed.  */
+        perror("mu: fork");
+        mark_not_started(p, 1);
+      } else {
+        /* This is the parent process.  */
+        job_table_set_pid(p, pid);
+        reaper_track(pid, p);
+        if (shell_is_interactive) {
+          if (!j->pgid)
+            job_table_set_pgid(j, pid);
+          setpgid(pid, j->pgid);
+        }
       }
     }
 
-    /* Clean up after pipes.  */
+    /* Clean up after pipes, and the files the child now has.  */
+    if (p->redirs)
+      redir_plan_close(p->redirs);
     if (infile != j->stdin)
       close(infile);
     if (outfile != j->stdout)
@@ -161,18 +327,48 @@ void launch_job(job *j, int foreground) {
     infile = mypipe[0];
   }
 
-  if (!foreground) {
-    format_job_info(j, "launched");
-  }
+  /* Stages the shell runs itself go once every child is running, so
+     the processes on the other ends of their pipes exist.  */
+  for (p = j->first_process; p; p = p->next)
+    if (p->in_shell)
+      run_in_shell(p);
 
-  if (!shell_is_interactive)
-    wait_for_job(j);
-  else if (foreground)
+  /* Nothing may be left to report on once every stage has been run or
+     failed to start.  */
+  if (job_is_completed(j))
+    job_table_changed(j);
+
+  if (!shell_is_interactive) {
+    if (foreground)
+      wait_for_job(j);
+  } else if (foreground)
     put_job_in_foreground(j, 0);
   else
     put_job_in_background(j, 0);
 }
 
+/* Exit status of a job, from its last process: the exit code, or 128
+   plus the signal that killed or stopped it.  */
+int job_status(job *j) {
+  process *p = j->first_process;
+  if (!p)
+    return 0;
+  while (p->next)
+    p = p->next;
+  return process_status(p);
+}
+
+/* A process's status the way $? shows it.  */
+int process_status(process *p) {
+  if (WIFEXITED(p->status))
+    return WEXITSTATUS(p->status);
+  if (WIFSIGNALED(p->status))
+    return 128 + WTERMSIG(p->status);
+  if (WIFSTOPPED(p->status))
+    return 128 + WSTOPSIG(p->status);
+  return 0;
+}
+
 /* Put job j in the foreground.  If cont is nonzero,
    restore the saved terminal modes and send the process group a
    SIGCONT signal to wake it up before we block.  */
@@ -216,64 +412,167 @@ void put_job_in_background(job *j, int cont) {
       perror("kill (SIGCONT)");
 }
 
-/* Store the status of the process pid that was returned by waitpid.
-   Return 0 if all went well, nonzero otherwise.  */
-
-int mark_process_status(pid_t pid, int status) {
-  job *j;
-  process *p;
-
-  if (pid > 0) {
-    /* Update the record for the process.  */
-    for (j = first_job; j; j = j->next)
-      for (p = j->first_process; p; p = p->next)
-        if (p->pid == pid) {
-          p->status = status;
-          if (WIFSTOPPED(status))
-            p->stopped = 1;
-          else {
-            p->completed = 1;
-            if (WIFSIGNALED(status))
-              fprintf(stderr, "\n%d: Terminated by signal %d.\n", (int)pid,
-                      WTERMSIG(p->status));
-          }
-          return 0;
-        }
-    // fprintf (stderr, "No child process %d.\n", pid);
-    return -1;
-  } else if (pid == 0 || errno == ECHILD)
-    /* No processes ready to report.  */
-    return -1;
-  else {
-    /* Other weird errors.  */
-    perror("waitpid");
-    return -1;
+/* Store a status waitpid() returned for p.  */
+void mark_process_status(process *p, int status) {
+  p->status = status;
+  if (p->job)
+    job_table_changed(p->job);
+  if (WIFSTOPPED(status)) {
+    p->stopped = 1;
+    return;
   }
+  p->completed = 1;
+  /* A writer killed by SIGPIPE is routine when the reader of
+     a pipeline (say, read) stops early.  */
+  if (WIFSIGNALED(status) && WTERMSIG(status) != SIGPIPE)
+    fprintf(stderr, "\n%d: Terminated by signal %d.\n", (int)p->pid,
+            WTERMSIG(p->status));
 }
 
 /* Check for processes that have status information available,
    without blocking.  */
 
-void update_status(void) {
-  int status;
-  pid_t pid;
-
-  do
-    pid = waitpid(WAIT_ANY, &status, WUNTRACED | WNOHANG);
-  while (!mark_process_status(pid, status));
-}
+void update_status(void) { reaper_poll(0); }
 
 /* Check for processes that have status information available,
    blocking until all processes in the given job have reported.  */
 
+/* What to block on for j: its process group when it has one, otherwise
+   the first of its processes still running.  */
+static pid_t job_wait_target(job *j) {
+  process *p;
+
+  if (shell_is_interactive && j->pgid)
+    return -j->pgid;
+  for (p = j->first_process; p; p = p->next)
+    if (p->pid > 0 && !p->completed && !p->stopped)
+      return p->pid;
+  return WAIT_ANY;
+}
+
 void wait_for_job(job *j) {
-  int status;
-  pid_t pid;
+  while (!job_is_stopped(j) && !job_is_completed(j))
+    if (reaper_wait(job_wait_target(j)) < 0)
+      break;
+}
+
+static int target_done(const wait_target *t) {
+  return t->p ? t->p->completed : job_is_completed(t->j);
+}
+
+/* The target's processes: all of its job's, or the one.  */
+static process *target_first(const wait_target *t) {
+  return t->p ? t->p : t->j->first_process;
+}
 
-  do
-    pid = waitpid(WAIT_ANY, &status, WUNTRACED);
-  while (!mark_process_status(pid, status) && !job_is_stopped(j) &&
-         !job_is_completed(j));
+static process *target_next(const wait_target *t, process *p) {
+  return t->p ? NULL : p->next;
+}
+
+int wait_target_status(const wait_target *t) {
+  return t->p ? process_status(t->p) : job_status(t->j);
+}
+
+static long now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/* Block until every target has finished, or with `any` until one has,
+   or until timeout_ms passes (-1: no limit).  Returns the index of the
+   target that settled it, -1 on timeout or -2 if interrupted by Ctrl-C.
+
+   Each process still running gets a pidfd, which turns readable when it
+   exits, so a wakeup is one poll() however many there are and other
+   children don't cause one.  Without pidfds the reaper's SIGCHLD wait
+   does the same job less selectively.  */
+int wait_for_targets(wait_target *t, int n, int any, int timeout_ms) {
+  int cap = 0;
+  for (int i = 0; i < n; i++)
+    for (process *p = target_first(&t[i]); p; p = target_next(&t[i], p))
+      cap++;
+
+  struct pollfd *fds = malloc(sizeof(struct pollfd) * (cap ? cap : 1));
+  process **procs = malloc(sizeof(process *) * (cap ? cap : 1));
+  if (!fds || !procs) {
+    perror("malloc");
+    exit(1);
+  }
+
+  int nfds = 0, use_pidfds = 1;
+  for (int i = 0; i < n && use_pidfds; i++)
+    for (process *p = target_first(&t[i]); p; p = target_next(&t[i], p)) {
+      if (p->pid <= 0 || p->completed)
+        continue;
+      int fd = reaper_pidfd(p->pid);
+      if (fd < 0) {
+        use_pidfds = 0;
+        break;
+      }
+      fds[nfds].fd = fd;
+      fds[nfds].events = POLLIN;
+      procs[nfds++] = p;
+    }
+
+  long deadline = timeout_ms >= 0 ? now_ms() + timeout_ms : 0;
+  int result = -1;
+  sigint_received = 0;
+
+  for (;;) {
+    reaper_poll(0);
+
+    int done = 0, first = -1;
+    for (int i = 0; i < n; i++)
+      if (target_done(&t[i])) {
+        done++;
+        if (first < 0)
+          first = i;
+      }
+    if (any ? done > 0 : done == n) {
+      result = any ? first : n - 1;
+      break;
+    }
+    if (sigint_received) {
+      result = -2;
+      break;
+    }
+
+    int wait_ms = -1;
+    if (timeout_ms >= 0) {
+      long left = deadline - now_ms();
+      if (left <= 0)
+        break;
+      wait_ms = (int)left;
+    }
+
+    // Stop watching the processes that have been collected
+    int kept = 0;
+    for (int k = 0; k < nfds; k++) {
+      if (procs[k]->completed) {
+        close(fds[k].fd);
+        continue;
+      }
+      fds[kept] = fds[k];
+      procs[kept++] = procs[k];
+    }
+    nfds = kept;
+
+    if (use_pidfds && nfds > 0) {
+      if (poll(fds, nfds, wait_ms) < 0 && errno != EINTR) {
+        perror("mu: poll");
+        break;
+      }
+    } else if (reaper_poll(wait_ms) < 0) {
+      break; /* no children left to wait for */
+    }
+  }
+
+  for (int k = 0; k < nfds; k++)
+    close(fds[k].fd);
+  free(fds);
+  free(procs);
+  return result;
 }
 
 /* Format information about job status for the user to look at.  */
@@ -286,36 +585,47 @@ void format_job_info(job *j, const char *status) {
    Delete terminated jobs from the active job list.  */
 
 void do_job_notification(void) {
-  job *j, *jlast, *jnext;
+  job *j;
 
   update_status();
 
-  jlast = NULL;
-  for (j = first_job; j; j = jnext) {
-    jnext = j->next;
-
+  /* Only jobs with a process that changed state can need reporting.  */
+  while ((j = job_table_next_changed())) {
     if (job_is_completed(j)) {
       // Only notify about background jobs
       if (j->is_background) {
         format_job_info(j, "completed");
       }
-      
-      if (jlast)
-        jlast->next = jnext;
-      else
-        first_job = jnext;
       free_job(j);
     }
     else if (job_is_stopped(j) && !j->notified) {
       format_job_info(j, "stopped");
       j->notified = 1;
-      jlast = j;
+      job_table_make_current(j);
     }
-    else
-      jlast = j;
   }
 }
 
+/* Free the jobs that have completed without a word about them: what
+   do_job_notification() does for a script, which reports nothing.  */
+void forget_completed_jobs(void) {
+  job *j;
+
+  update_status();
+  while ((j = job_table_next_changed()))
+    if (job_is_completed(j))
+      free_job(j);
+}
+
+/* The status of a foreground job launch_job() has waited for.  Once it
+   has completed it leaves the job table; a stopped one stays for fg.  */
+int finish_job(job *j) {
+  int status = job_status(j);
+  if (job_is_completed(j))
+    free_job(j);
+  return status;
+}
+
 /* Mark a stopped job J as being running again.  */
 
 void mark_job_as_running(job *j) {
@@ -330,6 +640,7 @@ void mark_job_as_running(job *j) {
 
 void continue_job(job *j, int foreground) {
   mark_job_as_running(j);
+  j->is_background = !foreground;
   if (foreground)
     put_job_in_foreground(j, 1);
   else
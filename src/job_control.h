@@ -6,22 +6,30 @@
 
 #include "job.h"
 
-extern job *first_job;
+// What `wait` waits for: a whole job, or one process of it
+typedef struct wait_target {
+  job *j;
+  process *p; /* just this process, if set */
+} wait_target;
 
 void launch_job(job *j, int foreground);
 void continue_job(job *j, int foreground);
 void do_job_notification(void);
+void forget_completed_jobs(void);
 job *find_job(pid_t pgid);
 void free_job(job *j);
 void wait_for_job(job *j);
 int job_is_completed(job *j);
 int job_is_stopped(job *j);
-void sigchld_handler(int sig);
+int job_status(job *j);
+int finish_job(job *j);
+int process_status(process *p);
+int wait_for_targets(wait_target *t, int n, int any, int timeout_ms);
+int wait_target_status(const wait_target *t);
 void setup_signal_handlers();
-int find_job_by_number(int job_num, job **found_job);
 void put_job_in_foreground(job *j, int cont);
 void put_job_in_background(job *j, int cont);
 void format_job_info(job *j, const char *status);
-int mark_process_status(pid_t pid, int status);
+void mark_process_status(process *p, int status);
 
 #endif
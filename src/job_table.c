@@ -0,0 +1,313 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "job_table.h"
+
+#define JOB_TABLE_INITIAL_CAP 16
+
+static job **slots; /* slots[id]; 0 is never used */
+static int slot_cap;
+static int max_id;  /* highest job number in use */
+static job *by_pgid[JOB_TABLE_BUCKETS];
+static job *by_name[JOB_TABLE_BUCKETS];
+static process *by_pid[JOB_TABLE_BUCKETS];
+static job *newest;                 /* %+ */
+static job *changed_head, *changed_tail;
+
+/* The command name is the first word of the command line.  */
+static size_t name_len(const char *command) {
+  size_t n = 0;
+  while (command[n] && command[n] != ' ' && command[n] != '\t')
+    n++;
+  return n;
+}
+
+/* FNV-1a, as in the command hash.  */
+static job **name_bucket(const char *name, size_t n) {
+  unsigned long h = 2166136261UL;
+  for (size_t i = 0; i < n; i++) {
+    h ^= (unsigned char)name[i];
+    h *= 16777619UL;
+  }
+  return &by_name[h % JOB_TABLE_BUCKETS];
+}
+
+static job **pgid_bucket(pid_t pgid) {
+  return &by_pgid[(unsigned)pgid % JOB_TABLE_BUCKETS];
+}
+
+static process **pid_bucket(pid_t pid) {
+  return &by_pid[(unsigned)pid % JOB_TABLE_BUCKETS];
+}
+
+static void link_pid(process *p) {
+  process **bucket = pid_bucket(p->pid);
+  p->pid_next = *bucket;
+  *bucket = p;
+}
+
+static void unlink_pid(process *p) {
+  process **e = pid_bucket(p->pid);
+  while (*e && *e != p)
+    e = &(*e)->pid_next;
+  if (*e)
+    *e = p->pid_next;
+  p->pid_next = NULL;
+}
+
+static void unlink_pgid(job *j) {
+  job **e = pgid_bucket(j->pgid);
+  while (*e && *e != j)
+    e = &(*e)->pgid_next;
+  if (*e)
+    *e = j->pgid_next;
+  j->pgid_next = NULL;
+}
+
+static void unlink_name(job *j) {
+  job **e = name_bucket(j->command, name_len(j->command));
+  while (*e && *e != j)
+    e = &(*e)->name_next;
+  if (*e)
+    *e = j->name_next;
+  j->name_next = NULL;
+}
+
+static void unlink_recent(job *j) {
+  if (j->newer)
+    j->newer->older = j->older;
+  else if (newest == j)
+    newest = j->older;
+  if (j->older)
+    j->older->newer = j->newer;
+  j->newer = j->older = NULL;
+}
+
+static void unlink_changed(job *j) {
+  if (!j->changed)
+    return;
+  if (j->changed_prev)
+    j->changed_prev->changed_next = j->changed_next;
+  else
+    changed_head = j->changed_next;
+  if (j->changed_next)
+    j->changed_next->changed_prev = j->changed_prev;
+  else
+    changed_tail = j->changed_prev;
+  j->changed_prev = j->changed_next = NULL;
+  j->changed = 0;
+}
+
+/* Give j the next job number and make it the current job.  Its command
+   line must already be set.  */
+void job_table_add(job *j) {
+  int id = max_id + 1;
+  if (id >= slot_cap) {
+    int cap = slot_cap ? slot_cap * 2 : JOB_TABLE_INITIAL_CAP;
+    job **grown = realloc(slots, sizeof(job *) * cap);
+    if (!grown) {
+      perror("realloc");
+      exit(1);
+    }
+    memset(grown + slot_cap, 0, sizeof(job *) * (cap - slot_cap));
+    slots = grown;
+    slot_cap = cap;
+  }
+  slots[id] = j;
+  j->id = max_id = id;
+
+  for (process *p = j->first_process; p; p = p->next) {
+    p->job = j;
+    if (p->pid)
+      link_pid(p);
+  }
+
+  if (j->command) {
+    job **bucket = name_bucket(j->command, name_len(j->command));
+    j->name_next = *bucket;
+    *bucket = j;
+  }
+  if (j->pgid) {
+    job **bucket = pgid_bucket(j->pgid);
+    j->pgid_next = *bucket;
+    *bucket = j;
+  }
+
+  j->older = newest;
+  if (newest)
+    newest->newer = j;
+  newest = j;
+}
+
+/* Take j out of the table; its number is free again.  */
+void job_table_remove(job *j) {
+  if (j->id <= 0 || j->id > max_id || slots[j->id] != j)
+    return;
+
+  slots[j->id] = NULL;
+  while (max_id > 0 && !slots[max_id])
+    max_id--;
+
+  if (j->pgid)
+    unlink_pgid(j);
+  for (process *p = j->first_process; p; p = p->next)
+    if (p->pid)
+      unlink_pid(p);
+  if (j->command)
+    unlink_name(j);
+  unlink_recent(j);
+  unlink_changed(j);
+  j->id = 0;
+}
+
+void job_table_set_pgid(job *j, pid_t pgid) {
+  if (j->pgid == pgid)
+    return;
+  if (j->id && j->pgid)
+    unlink_pgid(j);
+  j->pgid = pgid;
+  if (j->id && pgid) {
+    job **bucket = pgid_bucket(pgid);
+    j->pgid_next = *bucket;
+    *bucket = j;
+  }
+}
+
+/* p has been started as pid.  Only processes of jobs in the table are
+   hashed.  */
+void job_table_set_pid(process *p, pid_t pid) {
+  int listed = p->job && p->job->id;
+  if (listed && p->pid)
+    unlink_pid(p);
+  p->pid = pid;
+  if (listed && pid)
+    link_pid(p);
+}
+
+/* j was just stopped or put in the background: it becomes %+ and the
+   job that was becomes %-.  */
+void job_table_make_current(job *j) {
+  if (!j->id || newest == j)
+    return;
+  unlink_recent(j);
+  j->older = newest;
+  if (newest)
+    newest->newer = j;
+  newest = j;
+}
+
+/* Queue j to be looked at by the next job notification.  */
+void job_table_changed(job *j) {
+  if (!j->id || j->changed)
+    return;
+  j->changed = 1;
+  j->changed_prev = changed_tail;
+  if (changed_tail)
+    changed_tail->changed_next = j;
+  else
+    changed_head = j;
+  changed_tail = j;
+}
+
+/* The job that changed longest ago, taken off the queue.  */
+job *job_table_next_changed(void) {
+  job *j = changed_head;
+  if (j)
+    unlink_changed(j);
+  return j;
+}
+
+int job_table_max(void) { return max_id; }
+
+job *job_table_get(int id) {
+  return id > 0 && id <= max_id ? slots[id] : NULL;
+}
+
+job *job_table_find_pgid(pid_t pgid) {
+  job *j = *pgid_bucket(pgid);
+  while (j && j->pgid != pgid)
+    j = j->pgid_next;
+  return j;
+}
+
+/* The process of a job in the table that was started as pid.  */
+process *job_table_find_pid(pid_t pid) {
+  process *p = *pid_bucket(pid);
+  while (p && p->pid != pid)
+    p = p->pid_next;
+  return p;
+}
+
+job *job_table_current(void) { return newest; }
+
+job *job_table_previous(void) { return newest ? newest->older : NULL; }
+
+/* The one job whose command matches: contains text with `anywhere`,
+   otherwise starts with it.  Every job is looked at.  */
+static job *scan_commands(const char *text, int anywhere, int *ambiguous) {
+  job *found = NULL;
+  size_t n = strlen(text);
+
+  for (int id = 1; id <= max_id; id++) {
+    job *j = slots[id];
+    if (!j || !j->command)
+      continue;
+    if (anywhere ? !strstr(j->command, text) : strncmp(j->command, text, n))
+      continue;
+    if (found)
+      *ambiguous = 1;
+    found = j;
+  }
+  return found;
+}
+
+/* %name: through the name hash when name is a whole command name, which
+   is what it usually is; any other prefix of a command line takes a
+   scan.  */
+static job *find_named(const char *name, int *ambiguous) {
+  size_t n = strlen(name);
+  job *found = NULL;
+
+  for (job *j = *name_bucket(name, n); j; j = j->name_next) {
+    if (name_len(j->command) != n || strncmp(j->command, name, n) != 0)
+      continue;
+    if (found)
+      *ambiguous = 1;
+    found = j;
+  }
+  return found ? found : scan_commands(name, 0, ambiguous);
+}
+
+/* Look up a job spec: %N (or plain N), %+, %% or % for the current job,
+   %- for the previous one, %name for the job whose command starts with
+   name and %?text for the one whose command contains text.  Prints an
+   error for `who` and returns NULL unless it names exactly one job.  */
+job *job_table_resolve(const char *spec, const char *who) {
+  const char *s = spec[0] == '%' ? spec + 1 : spec;
+  int ambiguous = 0;
+  job *j = NULL;
+
+  if (*s == '\0' || strcmp(s, "+") == 0 || strcmp(s, "%") == 0) {
+    j = job_table_current();
+  } else if (strcmp(s, "-") == 0) {
+    j = job_table_previous();
+  } else if (isdigit((unsigned char)*s)) {
+    char *end;
+    long id = strtol(s, &end, 10);
+    if (*end == '\0' && id <= max_id)
+      j = job_table_get((int)id);
+  } else if (spec[0] == '%') {
+    j = s[0] == '?' ? scan_commands(s + 1, 1, &ambiguous)
+                    : find_named(s, &ambiguous);
+  }
+
+  if (ambiguous) {
+    fprintf(stderr, "mu: %s: %s: ambiguous job spec\n", who, spec);
+    return NULL;
+  }
+  if (!j)
+    fprintf(stderr, "mu: %s: %s: no such job\n", who, spec);
+  return j;
+}
@@ -0,0 +1,35 @@
+#ifndef JOB_TABLE_H
+#define JOB_TABLE_H
+
+#include <sys/types.h>
+
+#include "job.h"
+
+// Every job the shell knows about, by job number. A new job gets the
+// number after the highest one in use, so %2 means the same job for as
+// long as it lives; numbers and slots are reused once they are free.
+// Jobs are also hashed by process group and by command name, kept in
+// the order they were last made current for %+ and %-, and queued when
+// one of their processes changes state so notification only looks at
+// those. Their processes are hashed by pid, so `wait PID` finds one
+// without a scan.
+
+#define JOB_TABLE_BUCKETS 256
+
+void job_table_add(job *j);
+void job_table_remove(job *j);
+void job_table_set_pgid(job *j, pid_t pgid);
+void job_table_set_pid(process *p, pid_t pid);
+void job_table_make_current(job *j);
+void job_table_changed(job *j);
+job *job_table_next_changed(void);
+
+int job_table_max(void);
+job *job_table_get(int id);
+job *job_table_find_pgid(pid_t pgid);
+process *job_table_find_pid(pid_t pid);
+job *job_table_current(void);
+job *job_table_previous(void);
+job *job_table_resolve(const char *spec, const char *who);
+
+#endif
@@ -1,65 +1,286 @@
+#define _GNU_SOURCE /* posix_spawn_file_actions_addtcsetpgrp_np */
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <pwd.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "builtins.h"
+#include "cmdhash.h"
+#include "launch.h"
+#include "reaper.h"
+#include "redirect.h"
 
+extern char **environ;
 extern int debug_substitution;
+extern int shell_is_interactive;
+extern int shell_terminal;
 
-int mu_launch(char **args) {
+int mu_is_child = 0;
+
+// Live in a shared page so processes started by children are counted too
+static unsigned long *counters = NULL;
+#define FORKS 0
+#define SPAWNS 1
+
+static void init_counters(void) {
+  void *page = mmap(NULL, 2 * sizeof(*counters), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (page != MAP_FAILED)
+    counters = page;
+}
+
+static void count_process(int which) {
+  if (!counters)
+    init_counters();
+  if (counters)
+    __atomic_fetch_add(&counters[which], 1, __ATOMIC_RELAXED);
+}
+
+pid_t mu_fork(void) {
+  // Map the counters before the first fork so the child shares them
+  if (!counters)
+    init_counters();
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    mu_is_child = 1;
+    reaper_forget();
+    reaper_reset();
+  }
+  else if (pid > 0)
+    count_process(FORKS);
+  return pid;
+}
+
+unsigned long mu_fork_count(void) {
+  return counters ? __atomic_load_n(&counters[FORKS], __ATOMIC_RELAXED) : 0;
+}
+
+unsigned long mu_spawn_count(void) {
+  return counters ? __atomic_load_n(&counters[SPAWNS], __ATOMIC_RELAXED) : 0;
+}
+
+void mu_fork_count_reset(void) {
+  if (counters) {
+    __atomic_store_n(&counters[FORKS], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&counters[SPAWNS], 0, __ATOMIC_RELAXED);
+  }
+}
+
+/* Whether mu_spawn() can start a process with these requirements.  A
+   foreground job must own the terminal before it runs, which posix_spawn
+   can only do through a glibc extension; without it such jobs fork.  */
+int mu_can_spawn(int foreground) {
+  if (!MU_USE_SPAWN)
+    return 0;
+  if (shell_is_interactive && foreground)
+    return MU_SPAWN_TCSETPGRP;
+  return 1;
+}
+
+/* Start args[0] without copying the shell's address space: glibc's
+   posix_spawn runs the child on a vfork-style clone until it execs.  The
+   child gets the same setup launch_process() gives a forked child: its
+   process group (pgid 0 starts a new one), the terminal for a foreground
+   job, default job-control signals, an empty signal mask and
+   infile/outfile/errfile as fds 0-2, followed by an opened redirection
+   plan if there is one.  Returns the pid, or -1 with errno set if the
+   command could not be started.  */
+pid_t mu_spawn(char **args, pid_t pgid, int foreground, int infile,
+               int outfile, int errfile, const RedirPlan *redirs) {
+  posix_spawnattr_t attr;
+  posix_spawn_file_actions_t actions;
+  sigset_t mask;
+  short flags = POSIX_SPAWN_SETSIGMASK;
+  pid_t pid;
+
+  posix_spawnattr_init(&attr);
+  posix_spawn_file_actions_init(&actions);
+
+  sigemptyset(&mask);
+  posix_spawnattr_setsigmask(&attr, &mask);
+
+  if (shell_is_interactive) {
+    flags |= POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF;
+    posix_spawnattr_setpgroup(&attr, pgid);
+
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGQUIT);
+    sigaddset(&mask, SIGTSTP);
+    sigaddset(&mask, SIGTTIN);
+    sigaddset(&mask, SIGTTOU);
+    sigaddset(&mask, SIGCHLD);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+
+#if MU_SPAWN_TCSETPGRP
+    // Before the dups below, while the terminal is still on its fd
+    if (foreground && isatty(shell_terminal))
+      posix_spawn_file_actions_addtcsetpgrp_np(&actions, shell_terminal);
+#endif
+  }
+  posix_spawnattr_setflags(&attr, flags);
+
+  if (infile != STDIN_FILENO) {
+    posix_spawn_file_actions_adddup2(&actions, infile, STDIN_FILENO);
+    posix_spawn_file_actions_addclose(&actions, infile);
+  }
+  if (outfile != STDOUT_FILENO) {
+    posix_spawn_file_actions_adddup2(&actions, outfile, STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, outfile);
+  }
+  if (errfile != STDERR_FILENO) {
+    posix_spawn_file_actions_adddup2(&actions, errfile, STDERR_FILENO);
+    posix_spawn_file_actions_addclose(&actions, errfile);
+  }
+  if (redirs)
+    redir_plan_add_actions(redirs, &actions);
+
+  int err = ENOENT;
+  const char *path = cmdhash_lookup(args[0]);
+  if (path) {
+    err = posix_spawn(&pid, path, &actions, &attr, args, environ);
+    // The hashed binary went away: search PATH again
+    if (err == ENOENT && path != args[0]) {
+      cmdhash_forget(args[0]);
+      path = cmdhash_lookup(args[0]);
+      if (path)
+        err = posix_spawn(&pid, path, &actions, &attr, args, environ);
+    }
+  }
+
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+
+  if (err) {
+    errno = err;
+    return -1;
+  }
+  count_process(SPAWNS);
+  return pid;
+}
+
+/* Replace the current process with the command.  Only used in children
+   whose last job is this command, so there is nothing to return to.  */
+void mu_exec_tail(char **args) {
+  /* The shell's job-control signal settings must not leak into the
+     command; SIG_IGN would survive the exec.  */
+  signal(SIGINT, SIG_DFL);
+  signal(SIGQUIT, SIG_DFL);
+  signal(SIGTSTP, SIG_DFL);
+  signal(SIGTTIN, SIG_DFL);
+  signal(SIGTTOU, SIG_DFL);
+  signal(SIGCHLD, SIG_DFL);
+  reaper_reset();
+
+  if (debug_substitution)
+    fprintf(stderr, "DEBUG mu_exec_tail: exec %s in place\n", args[0]);
+
+  cmdhash_exec(args);
+  int err = errno;
+  perror("mu");
+  exit(err == ENOENT ? 127 : 126);
+}
+
+/* Run builtin number `index` in the shell.  Only the descriptors an
+   opened redirection plan replaces are saved and put back afterwards;
+   with no plan nothing is touched at all.  */
+int mu_run_builtin(int index, char **args, RedirPlan *redirs) {
+  if (redirs) {
+    fflush(stdout);
+    if (redir_plan_apply(redirs, 1)) {
+      redir_plan_restore(redirs);
+      return 1;
+    }
+  }
+
+  int status = (*builtin_func[index])(args);
+  // Builtin output must come out before the next command's
+  fflush(stdout);
+
+  if (redirs)
+    redir_plan_restore(redirs);
+  return status;
+}
+
+/* Run an external command in the foreground and wait for it.  `redirs`,
+   if set, must already be opened.  */
+int mu_launch(char **args, RedirPlan *redirs) {
   pid_t pid;
   int status;
 
   if (debug_substitution) {
-    fprintf(stderr, "DEBUG mu_launch: About to fork for command: %s\n",
+    fprintf(stderr, "DEBUG mu_launch: About to launch command: %s\n",
             args[0] ? args[0] : "(null)");
     for (int i = 0; args[i]; i++) {
       fprintf(stderr, "DEBUG mu_launch: args[%d] = '%s'\n", i, args[i]);
     }
   }
 
-  pid = fork();
-  if (pid == 0) {
-    // Child process
-    if (debug_substitution) {
-      fprintf(stderr, "DEBUG mu_launch: Child process calling execvp with %s\n",
-              args[0]);
+  if (mu_can_spawn(1)) {
+    pid = mu_spawn(args, 0, 1, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO,
+                   redirs);
+    if (pid < 0) {
+      int err = errno;
+      fprintf(stderr, "mu: %s: %s\n", args[0], strerror(err));
+      return err == ENOENT ? 127 : 126;
     }
+  } else {
+    // Resolve in the shell so the table outlives the child
+    cmdhash_lookup(args[0]);
+
+    pid = mu_fork();
+    if (pid == 0) {
+      // Child process
+      if (redirs && redir_plan_apply(redirs, 0))
+        exit(1);
+      if (debug_substitution) {
+        fprintf(stderr,
+                "DEBUG mu_launch: Child process calling execvp with %s\n",
+                args[0]);
+      }
 
-    if (execvp(args[0], args) == -1) {
-      fprintf(stderr, "DEBUG mu_launch: execvp failed: %s\n", strerror(errno));
+      cmdhash_exec(args);
+      int err = errno;
+      if (debug_substitution)
+        fprintf(stderr, "DEBUG mu_launch: exec failed: %s\n", strerror(err));
       perror("mu");
-      exit(EXIT_FAILURE);
+      exit(err == ENOENT ? 127 : 126);
+    } else if (pid < 0) {
+      perror("mu");
+      return 1;
     }
-    // This should never be reached if execvp succeeds
-    exit(EXIT_SUCCESS);
-  } else if (pid < 0) {
-    perror("mu");
-    return 1;
-  } else {
-    // Parent process
-    do {
-      // wpid = waitpid(pid, &status, WUNTRACED);
-    } while (!WIFEXITED(status) && !WIFSIGNALED(status));
-
-    int exit_status = WEXITSTATUS(status);
-    if (debug_substitution) {
-      fprintf(stderr, "DEBUG mu_launch: Child exited with status %d\n",
-              exit_status);
+  }
+
+  // Wait for it in the parent
+  for (;;) {
+    if (reaper_wait_pid(pid, &status) < 0) {
+      perror("waitpid");
+      return 1;
     }
-    return exit_status;
+    if (WIFEXITED(status) || WIFSIGNALED(status))
+      break;
+  }
+
+  int exit_status = WIFEXITED(status) ? WEXITSTATUS(status)
+                                      : 128 + WTERMSIG(status);
+  if (debug_substitution) {
+    fprintf(stderr, "DEBUG mu_launch: Child exited with status %d\n",
+            exit_status);
   }
+  return exit_status;
 }
 
-int mu_execute(char **args) {
+int mu_execute(char **args, RedirPlan *redirs) {
   if (args[0] == NULL)
     return 0; // Empty command
 
@@ -83,11 +304,11 @@ int mu_execute(char **args) {
   // Check for built-ins
   for (int i = 0; i < mu_num_builtins(); i++) {
     if (strcmp(args[0], builtin_str[i]) == 0) {
-      int status = (*builtin_func[i])(args);
+      int status = mu_run_builtin(i, args, redirs);
       return negate ? !status : status;
     }
   }
 
-  int status = mu_launch(args);
+  int status = mu_launch(args, redirs);
   return negate ? !status : status;
 }
@@ -1,7 +1,38 @@
 #ifndef LAUNCH_H
 #define LAUNCH_H
 
-int mu_launch(char **args);
-int mu_execute(char **args);
+#include <sys/types.h>
+
+struct RedirPlan;
+
+// Build with -DMU_USE_SPAWN=0 to start every command with fork()
+#ifndef MU_USE_SPAWN
+#define MU_USE_SPAWN 1
+#endif
+
+// posix_spawn_file_actions_addtcsetpgrp_np() appeared in glibc 2.35
+#if defined(__GLIBC__) &&                                                      \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define MU_SPAWN_TCSETPGRP 1
+#else
+#define MU_SPAWN_TCSETPGRP 0
+#endif
+
+// Set in every process mu_fork() creates
+extern int mu_is_child;
+
+pid_t mu_fork(void);
+unsigned long mu_fork_count(void);
+unsigned long mu_spawn_count(void);
+void mu_fork_count_reset(void);
+
+int mu_can_spawn(int foreground);
+pid_t mu_spawn(char **args, pid_t pgid, int foreground, int infile,
+               int outfile, int errfile, const struct RedirPlan *redirs);
+
+void mu_exec_tail(char **args);
+int mu_run_builtin(int index, char **args, struct RedirPlan *redirs);
+int mu_launch(char **args, struct RedirPlan *redirs);
+int mu_execute(char **args, struct RedirPlan *redirs);
 
 #endif
@@ -1,8 +1,11 @@
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "builtins.h"
 #include "execute.h"
+#include "expand.h"
 #include "init.h"
 #include "input.h"
 #include "promptly/promptly.h"
@@ -10,6 +13,8 @@
 #include "promptly/history.h"
 #include "promptly/config.h"
 #include "job_control.h"
+#include "reaper.h"
+#include "script.h"
 
 #define MU_RL_BUFSIZE 1024
 #define MU_TOK_BUFSIZE 64
@@ -21,8 +26,39 @@ extern volatile sig_atomic_t job_notification_pending;
  
 int debug_substitution = 0;
 
-int main() {
-    mu_init();
+/* mu -c 'commands' [name [args...]], mu script [args...], or commands
+   piped into stdin.  No prompt, history or job control is set up.  */
+int run_noninteractive(int argc, char **argv) {
+    mu_init(0);
+
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "mu: -c: option requires an argument\n");
+            return 2;
+        }
+        // $0 is the name after the commands, as in sh -c
+        if (argc > 3)
+            mu_set_positional(argc - 3, argv + 3);
+        else
+            mu_set_positional(1, argv);
+        return mu_run_string(argv[2]);
+    }
+
+    if (argc > 1) {
+        mu_set_positional(argc - 1, argv + 1);
+        return mu_run_script(argv[1]);
+    }
+
+    mu_set_positional(1, argv);
+    return mu_run_fd(STDIN_FILENO);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 || !isatty(STDIN_FILENO))
+        return run_noninteractive(argc, argv);
+
+    mu_set_positional(1, argv);
+    mu_init(1);
     setup_signal_handlers();
     init_config();
 
@@ -34,7 +70,8 @@ int main() {
             
         restore_terminal_control();
         
-        //TODO: Notify immediately if any job status changed (set by SIGCHLD handler)
+        // Collect whatever children changed state while we were busy
+        reaper_poll(0);
         if (job_notification_pending) {
             do_job_notification();
             job_notification_pending = 0;
@@ -74,5 +111,5 @@ int main() {
     // Clean up promptly resources before exit
     cleanup_history();
     
-    return EXIT_SUCCESS;
+    return mu_last_status;
 }
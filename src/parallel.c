@@ -0,0 +1,345 @@
+#define _GNU_SOURCE /* memfd_create, mkostemp */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "argv.h"
+#include "expand.h"
+#include "job.h"
+#include "job_control.h"
+#include "parallel.h"
+#include "reaper.h"
+#include "signal_handlers.h"
+
+char *argv_join(char **argv);
+
+typedef struct Task {
+  job *j;
+  long seq;  /* position of its input */
+  int out;   /* buffered stdout */
+  int err;   /* buffered stderr */
+  int pidfd; /* readable once it exits, or -1 */
+} Task;
+
+typedef struct Inputs {
+  char **words; /* after :::, or NULL to read lines from stdin */
+  FILE *lines;
+  char *line;
+  size_t line_cap;
+} Inputs;
+
+/* The next input, or NULL when there are no more.  */
+static const char *next_input(Inputs *in) {
+  if (in->words)
+    return *in->words ? *in->words++ : NULL;
+
+  ssize_t n = getline(&in->line, &in->line_cap, in->lines);
+  if (n < 0)
+    return NULL;
+  if (n > 0 && in->line[n - 1] == '\n')
+    in->line[n - 1] = '\0';
+  return in->line;
+}
+
+/* An anonymous file to collect output in.  */
+static int buffer_fd(void) {
+#ifdef MFD_CLOEXEC
+  int fd = memfd_create("mu-parallel", MFD_CLOEXEC);
+  if (fd >= 0)
+    return fd;
+#endif
+  char path[] = "/tmp/mu-parallel-XXXXXX";
+  int tmp = mkostemp(path, O_CLOEXEC);
+  if (tmp >= 0)
+    unlink(path);
+  return tmp;
+}
+
+/* The command line for one input: {} replaced wherever it appears, or
+   the input added at the end.  */
+static ArgvBuilder *task_argv(char **cmd, int cmd_argc, const char *input) {
+  static StrBuf arg;
+  ArgvBuilder *b = argv_new();
+  int replaced = 0;
+
+  for (int k = 0; k < cmd_argc; k++) {
+    const char *s = cmd[k];
+    const char *hit = strstr(s, "{}");
+    if (!hit) {
+      argv_push(b, arena_strndup(&b->arena, s, strlen(s)));
+      continue;
+    }
+
+    strbuf_reset(&arg);
+    for (; hit; s = hit + 2, hit = strstr(s, "{}")) {
+      strbuf_append(&arg, s, hit - s);
+      strbuf_append(&arg, input, strlen(input));
+    }
+    strbuf_append(&arg, s, strlen(s));
+    argv_push(b, arena_strndup(&b->arena, arg.data, arg.len));
+    replaced = 1;
+  }
+
+  if (!replaced)
+    argv_push(b, arena_strndup(&b->arena, input, strlen(input)));
+  return b;
+}
+
+/* Launch the command for one input in the background, its output going
+   to buffers.  Returns 1 after printing an error if they can't be made.  */
+static int start_task(Task *t, char **cmd, int cmd_argc, const char *input,
+                      long seq, int devnull) {
+  t->out = buffer_fd();
+  t->err = buffer_fd();
+  if (t->out < 0 || t->err < 0) {
+    perror("mu: parallel");
+    if (t->out >= 0)
+      close(t->out);
+    if (t->err >= 0)
+      close(t->err);
+    return 1;
+  }
+
+  process *p = calloc(1, sizeof(process));
+  job *j = calloc(1, sizeof(job));
+  if (!p || !j) {
+    perror("calloc");
+    exit(1);
+  }
+  p->argv_owner = task_argv(cmd, cmd_argc, input);
+  p->argv = p->argv_owner->argv;
+  j->first_process = p;
+  j->command = argv_join(p->argv);
+  j->stdin = devnull;
+  j->stdout = t->out;
+  j->stderr = t->err;
+  j->is_background = 1;
+
+  launch_job(j, 0);
+
+  t->j = j;
+  t->seq = seq;
+  t->pidfd = p->pid > 0 ? reaper_pidfd(p->pid) : -1;
+  return 0;
+}
+
+static void copy_out(int from, int to) {
+  static char buf[65536];
+  ssize_t n;
+
+  lseek(from, 0, SEEK_SET);
+  while ((n = read(from, buf, sizeof(buf))) > 0) {
+    char *p = buf;
+    while (n > 0) {
+      ssize_t w = write(to, p, n);
+      if (w < 0) {
+        if (errno == EINTR)
+          continue;
+        return;
+      }
+      p += w;
+      n -= w;
+    }
+  }
+}
+
+/* Write out a finished task's output and let it go.  */
+static void finish_task(Task *t) {
+  copy_out(t->out, STDOUT_FILENO);
+  copy_out(t->err, STDERR_FILENO);
+  close(t->out);
+  close(t->err);
+  if (t->pidfd >= 0)
+    close(t->pidfd);
+  free_job(t->j);
+  t->j = NULL;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Block until one of the running tasks may have finished.  */
+static void wait_tasks(Task *running, int count, struct pollfd *fds) {
+  for (int k = 0; k < count; k++) {
+    if (running[k].pidfd < 0) {
+      reaper_poll(-1);
+      return;
+    }
+    fds[k].fd = running[k].pidfd;
+    fds[k].events = POLLIN;
+  }
+  if (poll(fds, count, -1) < 0 && errno != EINTR)
+    perror("mu: parallel: poll");
+}
+
+static void usage(void) {
+  fprintf(stderr,
+          "usage: parallel [-j N] [-k] command [arg...] [::: input...]\n");
+}
+
+/* Exits with the number of runs that failed (at most 101), or 130 if
+   interrupted.  A summary goes to stderr at the end.  */
+int mu_parallel(char **args) {
+  int slots = -1, keep = 0;
+  int i = 1;
+
+  for (; args[i] && args[i][0] == '-'; i++) {
+    if (strcmp(args[i], "--") == 0) {
+      i++;
+      break;
+    }
+    if (strcmp(args[i], "-k") == 0) {
+      keep = 1;
+    } else if (strncmp(args[i], "-j", 2) == 0) {
+      const char *n = args[i][2] ? args[i] + 2 : args[++i];
+      char *end;
+      if (!n || (slots = (int)strtol(n, &end, 10)) < 0 || *end) {
+        fprintf(stderr, "mu: parallel: -j needs a number of jobs\n");
+        return 2;
+      }
+    } else {
+      fprintf(stderr, "mu: parallel: %s: invalid option\n", args[i]);
+      usage();
+      return 2;
+    }
+  }
+
+  char **cmd = &args[i];
+  int cmd_argc = 0;
+  while (cmd[cmd_argc] && strcmp(cmd[cmd_argc], ":::") != 0)
+    cmd_argc++;
+  if (cmd_argc == 0) {
+    usage();
+    return 2;
+  }
+
+  // -j 0, or none: one per online CPU
+  if (slots <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    slots = cpus > 0 ? (int)cpus : 1;
+  }
+
+  Inputs in = {0};
+  if (cmd[cmd_argc]) {
+    in.words = &cmd[cmd_argc + 1];
+  } else {
+    int fd = dup(STDIN_FILENO);
+    in.lines = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!in.lines) {
+      perror("mu: parallel: stdin");
+      if (fd >= 0)
+        close(fd);
+      return 1;
+    }
+  }
+
+  // Runs must not read what is meant as input, or the terminal
+  int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  long window = (long)slots * PARALLEL_KEEP_WINDOW;
+  Task *running = calloc(slots, sizeof(Task));
+  Task *held = keep ? calloc(window, sizeof(Task)) : NULL;
+  struct pollfd *fds = calloc(slots, sizeof(struct pollfd));
+  if (devnull < 0 || !running || (keep && !held) || !fds) {
+    perror("mu: parallel");
+    exit(1);
+  }
+
+  // Output written before the runs' must come out first
+  fflush(stdout);
+
+  long started = 0, written = 0, failed = 0;
+  int count = 0, inputs_done = 0, interrupted = 0;
+  double t0 = now_seconds();
+  sigint_received = 0;
+
+  for (;;) {
+    while (!inputs_done && count < slots &&
+           (!keep || started - written < window)) {
+      const char *input = next_input(&in);
+      if (!input) {
+        inputs_done = 1;
+        break;
+      }
+      if (start_task(&running[count], cmd, cmd_argc, input, started,
+                     devnull)) {
+        inputs_done = 1;
+        failed++;
+        break;
+      }
+      count++;
+      started++;
+    }
+
+    // Collect the tasks that have finished
+    int collected = 0;
+    reaper_poll(0);
+    for (int k = count - 1; k >= 0; k--) {
+      Task *t = &running[k];
+      if (!job_is_completed(t->j))
+        continue;
+      if (job_status(t->j) != 0)
+        failed++;
+      if (keep) {
+        held[t->seq % window] = *t;
+      } else {
+        finish_task(t);
+        written++;
+      }
+      running[k] = running[--count];
+      collected++;
+    }
+    while (keep && held[written % window].j &&
+           held[written % window].seq == written)
+      finish_task(&held[written++ % window]);
+
+    if (count == 0 && inputs_done)
+      break;
+
+    if (sigint_received && !interrupted) {
+      // Stop starting runs and end the ones going
+      interrupted = inputs_done = 1;
+      for (int k = 0; k < count; k++)
+        for (process *p = running[k].j->first_process; p; p = p->next)
+          if (p->pid > 0 && !p->completed)
+            kill(p->pid, SIGTERM);
+      continue;
+    }
+
+    if (!collected)
+      wait_tasks(running, count, fds);
+  }
+
+  // Interrupted with -k: what finished ahead of the gap is written too
+  for (long k = 0; keep && k < window; k++)
+    if (held[k].j)
+      finish_task(&held[k]);
+
+  double elapsed = now_seconds() - t0;
+  fprintf(stderr, "parallel: %ld jobs, %ld failed, %d at a time, %.2fs",
+          started, failed, slots, elapsed);
+  if (elapsed > 0)
+    fprintf(stderr, " (%.1f jobs/s)", started / elapsed);
+  fputc('\n', stderr);
+
+  close(devnull);
+  if (in.lines)
+    fclose(in.lines);
+  free(in.line);
+  free(running);
+  free(held);
+  free(fds);
+
+  if (interrupted)
+    return 130;
+  return failed > 101 ? 101 : (int)failed;
+}
@@ -0,0 +1,18 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// parallel [-j N] [-k] command [arg...] [::: input...]
+// Runs the command once per input, N at a time, as jobs started with
+// launch_job(). {} in an argument is replaced by the input; without one
+// the input becomes the last argument. Inputs are the words after :::,
+// or else the lines of standard input. Each run's stdout and stderr go
+// to memory files and are written out whole when it finishes, or with
+// -k in input order.
+
+// With -k, how many runs per slot may finish ahead of the oldest one
+// whose output hasn't been written yet; each holds two descriptors
+#define PARALLEL_KEEP_WINDOW 16
+
+int mu_parallel(char **args);
+
+#endif
@@ -4,13 +4,24 @@
 #include <sys/types.h>
 #include <termios.h>
 
+struct ASTNode;
+struct RedirPlan;
+struct job;
+
 typedef struct process {
   struct process *next; /* next process in pipeline */
   char **argv;          /* for exec */
+  struct ArgvBuilder *argv_owner; /* owns argv and its strings, if set */
+  struct ASTNode *node; /* run by a forked shell instead, if set */
+  struct RedirPlan *redirs; /* applied after the pipe ends, if set */
+  char in_shell;        /* run by the shell itself, on infd/outfd */
+  int infd, outfd;
   pid_t pid;            /* process ID */
   char completed;       /* true if process has completed */
   char stopped;         /* true if process has stopped */
   int status;           /* reported status value */
+  struct job *job;      /* the job it belongs to, once in the job table */
+  struct process *pid_next; /* next process in the same pid bucket */
 } process;
 
 #endif
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gap_buffer.h"
+
+#define GAP_INITIAL_SIZE 256
+
+void gap_init(GapBuffer *gb) {
+    gb->text = malloc(GAP_INITIAL_SIZE);
+    if (!gb->text) {
+        perror("malloc");
+        exit(1);
+    }
+    gb->size = GAP_INITIAL_SIZE;
+    gb->gap_start = 0;
+    gb->gap_end = gb->size;
+}
+
+void gap_free(GapBuffer *gb) {
+    free(gb->text);
+    gb->text = NULL;
+    gb->size = gb->gap_start = gb->gap_end = 0;
+}
+
+size_t gap_length(const GapBuffer *gb) {
+    return gb->size - (gb->gap_end - gb->gap_start);
+}
+
+void gap_move(GapBuffer *gb, size_t pos) {
+    if (pos < gb->gap_start) {
+        // What lies between pos and the gap goes to the far side of it
+        size_t n = gb->gap_start - pos;
+        memmove(gb->text + gb->gap_end - n, gb->text + pos, n);
+        gb->gap_start -= n;
+        gb->gap_end -= n;
+    } else if (pos > gb->gap_start) {
+        size_t n = pos - gb->gap_start;
+        memmove(gb->text + gb->gap_start, gb->text + gb->gap_end, n);
+        gb->gap_start += n;
+        gb->gap_end += n;
+    }
+}
+
+// At least len bytes of gap; the size doubles so growth is amortized
+static void gap_reserve(GapBuffer *gb, size_t len) {
+    size_t gap = gb->gap_end - gb->gap_start;
+    if (gap >= len)
+        return;
+
+    size_t after = gb->size - gb->gap_end;
+    size_t size = gb->size * 2;
+    while (size - (gb->size - gap) < len)
+        size *= 2;
+
+    char *text = realloc(gb->text, size);
+    if (!text) {
+        perror("realloc");
+        exit(1);
+    }
+    memmove(text + size - after, text + gb->gap_end, after);
+    gb->text = text;
+    gb->gap_end = size - after;
+    gb->size = size;
+}
+
+void gap_insert(GapBuffer *gb, size_t pos, const char *text, size_t len) {
+    gap_move(gb, pos);
+    gap_reserve(gb, len);
+    memcpy(gb->text + gb->gap_start, text, len);
+    gb->gap_start += len;
+}
+
+void gap_delete(GapBuffer *gb, size_t pos, size_t len) {
+    if (pos + len == gb->gap_start) {  // Backspace: the gap takes it in
+        gb->gap_start = pos;
+        return;
+    }
+    gap_move(gb, pos);
+    gb->gap_end += len;
+}
+
+char *gap_text(GapBuffer *gb) {
+    gap_move(gb, gap_length(gb));
+    gap_reserve(gb, 1);
+    gb->text[gb->gap_start] = '\0';
+    return gb->text;
+}
@@ -0,0 +1,32 @@
+#ifndef GAP_BUFFER_H
+#define GAP_BUFFER_H
+
+#include <stddef.h>
+
+// The line being edited.  The text is kept in one allocation with a hole
+// (the gap) where the last edit happened: text[0..gap_start) and
+// text[gap_end..size) are the line.  Typing or deleting at the gap only
+// moves one of its ends, so editing at the cursor doesn't shift the rest
+// of the line however long it is; the gap follows the cursor lazily, on
+// the next edit somewhere else.
+typedef struct {
+    char *text;
+    size_t gap_start;
+    size_t gap_end;
+    size_t size;
+} GapBuffer;
+
+void gap_init(GapBuffer *gb);
+void gap_free(GapBuffer *gb);
+size_t gap_length(const GapBuffer *gb);
+
+// Moves the gap to pos, so text[0..pos) is the line up to there
+void gap_move(GapBuffer *gb, size_t pos);
+
+void gap_insert(GapBuffer *gb, size_t pos, const char *text, size_t len);
+void gap_delete(GapBuffer *gb, size_t pos, size_t len);
+
+// The whole line as one NUL-terminated string, valid until the next edit
+char *gap_text(GapBuffer *gb);
+
+#endif
@@ -2,7 +2,6 @@
 #include <string.h>
 
 #define MAX_HISTORY 1000
-#define MAX_LINE_LENGTH 1024
 
 typedef struct {
     char **entries;
@@ -13,7 +12,6 @@ typedef struct {
 
 History history = {NULL, 0, 0, -1};
 char *temp_line = NULL;  // For storing current line when navigating history
-char *current_line;
 
 // History functions
 void init_history() {
@@ -48,7 +46,8 @@ void add_to_history(const char *line) {
     history.current_index = -1;  // Reset to indicate we're not browsing history
 }
 
-char *get_history_entry(int direction) {
+// line is what is being typed, kept to come back to past the newest entry
+char *get_history_entry(int direction, const char *line) {
     init_history();
     
     if (history.count == 0) return NULL;
@@ -57,7 +56,7 @@ char *get_history_entry(int direction) {
         if (history.current_index == -1) {
             // First time browsing history, save current line
             if (temp_line) free(temp_line);
-            temp_line = strdup(current_line);
+            temp_line = strdup(line);
             history.current_index = history.count - 1;
         } else if (history.current_index > 0) {
             history.current_index--;
@@ -11,7 +11,6 @@
 
 // Constants
 #define MAX_HISTORY 1000
-#define MAX_LINE_LENGTH 1024
 
 // History structure
 typedef struct {
@@ -23,12 +22,11 @@ typedef struct {
 
 extern History history;
 extern char *temp_line;  // For storing current line when navigating history
-extern char *current_line;
 
 // History management functions
 void init_history(void);
 void add_to_history(const char *line);
-char *get_history_entry(int direction);
+char *get_history_entry(int direction, const char *line);
 void cleanup_history(void);
 
 #endif /* HISTORY_H */
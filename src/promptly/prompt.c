@@ -12,6 +12,26 @@
 extern int mu_last_status;
 extern size_t lines_count;
 
+int prompt_columns = 0;
+
+// Columns text takes on screen: escape sequences take none, and a UTF-8
+// character takes one
+static int visible_columns(const char *text) {
+    int columns = 0;
+    for (const char *p = text; *p; p++) {
+        if (*p == '\033' && p[1] == '[') {
+            p += 2;
+            while (*p && (*p < '@' || *p > '~'))
+                p++;
+            if (!*p)
+                break;
+        } else if ((*p & 0xC0) != 0x80) {
+            columns++;
+        }
+    }
+    return columns;
+}
+
 // Helper function to get current working directory, abbreviated if needed
 static void get_abbreviated_cwd(char *buffer, size_t buffer_size) {
     char cwd[PATH_MAX];
@@ -76,6 +96,7 @@ void print_prompt() {
     if (lines_count > 0) {
         printf("> ");
         fflush(stdout);
+        prompt_columns = 2;
         return;
     }
     
@@ -180,4 +201,5 @@ void print_prompt() {
     // Apply prompt color and print
     printf("%s%s%s", get_color(config.color_prompt), prompt, get_color(config.color_reset));
     fflush(stdout);
+    prompt_columns = visible_columns(prompt);
 }
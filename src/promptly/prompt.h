@@ -3,4 +3,7 @@
 
 void print_prompt();
 
+// Screen columns the last prompt printed takes up
+extern int prompt_columns;
+
 #endif
@@ -1,7 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <termios.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <time.h>
@@ -11,8 +10,12 @@
 #include "prompt.h"
 #include "history.h"
 #include "cursor.h"
+#include "gap_buffer.h"
+#include "render.h"
+#include "terminal.h"
 
-char *current_line = NULL;
+// The line being edited; line_length follows its length
+static GapBuffer line_buf;
 extern int cursor_pos;
 extern int min_cursor_pos;
 
@@ -20,67 +23,93 @@ int line_length = 0;
 
 extern History history;
 extern char *temp_line;  // For storing current line when navigating history
-extern char *current_line;
 
-// Character reading function
+// Next key byte, from the block of input the terminal last handed over;
+// the terminal is already raw for the whole line
 int read_char(void) {
-    struct termios oldt, newt;
-    int ch;
-    
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    
-    ch = getchar();
-    
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-    return ch;
+    return read_byte();
+}
+
+// Bring the screen up to date with the line; written out once no more
+// keys are waiting
+void refresh_line(void) {
+    // Edits only happen after the prompt, so the gap never lies before it
+    render_line(line_buf.text + min_cursor_pos, line_buf.gap_start - min_cursor_pos,
+                line_buf.text + line_buf.gap_end, line_buf.size - line_buf.gap_end,
+                cursor_pos - min_cursor_pos);
+}
+
+// A prompt was just printed again: redraw the whole line after it
+static void redraw_line(void) {
+    render_flush();
+    print_prompt();
+    render_reset(prompt_columns);
+    refresh_line();
 }
 
 // Insert character at cursor position
 void insert_char(char c) {
-    if (line_length >= MAX_LINE_LENGTH - 1) return;
-    
-    // Shift characters to the right
-    memmove(current_line + cursor_pos + 1, current_line + cursor_pos, line_length - cursor_pos);
-    current_line[cursor_pos] = c;
+    gap_insert(&line_buf, cursor_pos, &c, 1);
     line_length++;
     cursor_pos++;
+    refresh_line();
+}
+
+// Insert a block of text at the cursor with a single redraw, as a paste
+// is.  Keys in it mean nothing: a tab is not completion and a newline
+// doesn't end the line but separates the commands on it.  Carriage
+// returns become newlines and other control characters are dropped.
+void insert_text(const char *text, size_t len) {
+    char *kept = malloc(len ? len : 1);
+    size_t n = 0;
     
-    // If we're at the end of the line, just print the character
-    if (cursor_pos == line_length) {
-        printf("%c", c);
-    } else {
-        // We're in the middle - need to reprint from cursor position
-        for (int i = cursor_pos - 1; i < line_length; i++) {
-            printf("%c", current_line[i]);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = text[i];
+        if (c == '\r') {
+            if (i + 1 < len && text[i + 1] == '\n') continue;
+            c = '\n';
+        }
+        if ((c < 32 && c != '\n' && c != '\t') || c == 127) continue;
+        kept[n++] = c;
+    }
+    
+    gap_insert(&line_buf, cursor_pos, kept, n);
+    line_length += n;
+    cursor_pos += n;
+    free(kept);
+    refresh_line();
+}
+
+// Collect a bracketed paste up to its closing ESC[201~ and insert it
+static void handle_paste(void) {
+    static const char end_marker[] = "\033[201~";
+    size_t marker_len = sizeof(end_marker) - 1;
+    size_t cap = 4096, len = 0;
+    char *text = malloc(cap);
+    int c;
+    
+    while ((c = read_char()) != EOF) {
+        if (len == cap) {
+            cap *= 2;
+            text = realloc(text, cap);
         }
-        // Move cursor back to correct position
-        if (line_length > cursor_pos) {
-            printf("\033[%dD", line_length - cursor_pos);
+        text[len++] = c;
+        if (len >= marker_len && memcmp(text + len - marker_len, end_marker, marker_len) == 0) {
+            len -= marker_len;
+            break;
         }
     }
-    fflush(stdout);
+    insert_text(text, len);
+    free(text);
 }
 
 // Delete character at cursor position
 void delete_char() {
     if (cursor_pos >= line_length) return;
     
-    memmove(current_line + cursor_pos, current_line + cursor_pos + 1, line_length - cursor_pos - 1);
+    gap_delete(&line_buf, cursor_pos, 1);
     line_length--;
-    
-    // Clear from cursor to end of line and reprint
-    printf("\033[K");
-    for (int i = cursor_pos; i < line_length; i++) {
-        printf("%c", current_line[i]);
-    }
-    // Move cursor back to original position
-    if (line_length > cursor_pos) {
-        printf("\033[%dD", line_length - cursor_pos);
-    }
-    fflush(stdout);
+    refresh_line();
 }
 
 // Delete character before cursor (backspace)
@@ -88,44 +117,20 @@ void backspace_char() {
     if (cursor_pos <= min_cursor_pos) return;  // Don't delete past prompt
     
     cursor_pos--;
-    memmove(current_line + cursor_pos, current_line + cursor_pos + 1, line_length - cursor_pos - 1);
+    gap_delete(&line_buf, cursor_pos, 1);
     line_length--;
-    
-    // Move cursor back, clear from cursor to end, reprint remainder
-    printf("\b\033[K");
-    for (int i = cursor_pos; i < line_length; i++) {
-        printf("%c", current_line[i]);
-    }
-    // Move cursor back to correct position
-    if (line_length > cursor_pos) {
-        printf("\033[%dD", line_length - cursor_pos);
-    }
-    fflush(stdout);
+    refresh_line();
 }
 
-
-
 // Replace current line with new content
 void replace_line(const char *new_content) {
-    // Move cursor to beginning of input area
-    if (cursor_pos > min_cursor_pos) {
-        printf("\033[%dD", cursor_pos - min_cursor_pos);
-    }
-    
-    // Clear from cursor to end of line
-    printf("\033[K");
-    
-    // Copy new content and print it
-    strcpy(current_line + min_cursor_pos, new_content);
-    line_length = min_cursor_pos + strlen(new_content);
-    printf("%s", new_content);
+    gap_delete(&line_buf, min_cursor_pos, line_length - min_cursor_pos);
+    gap_insert(&line_buf, min_cursor_pos, new_content, strlen(new_content));
+    line_length = gap_length(&line_buf);
     cursor_pos = line_length;
-    
-    fflush(stdout);
+    refresh_line();
 }
 
-
-
 // Add these helper functions for directory completion
 
 // Check if a path is a directory
@@ -238,6 +243,10 @@ void expand_home(const char *path, char *expanded) {
 void handle_tab_completion() {
     if (cursor_pos == min_cursor_pos) return;  // No input to complete
     
+    // Everything up to the cursor in one piece
+    gap_move(&line_buf, cursor_pos);
+    const char *current_line = line_buf.text;
+    
     // Extract the current word being typed
     int word_start = cursor_pos - 1;
     while (word_start > min_cursor_pos && current_line[word_start - 1] != ' ' && current_line[word_start - 1] != '\t') {
@@ -248,6 +257,10 @@ void handle_tab_completion() {
     if (word_len == 0) return;
     
     char word[512];
+    if (word_len >= (int)sizeof(word)) {
+        render_text("\a", 1);  // Nothing completes a word that long
+        return;
+    }
     strncpy(word, current_line + word_start, word_len);
     word[word_len] = '\0';
     
@@ -264,8 +277,7 @@ void handle_tab_completion() {
         int match_count = get_directory_matches(dir, filename, matches, 100);
         
         if (match_count == 0) {
-            printf("\a");  // Beep for no matches
-            fflush(stdout);
+            render_text("\a", 1);  // Beep for no matches
             return;
         }
         
@@ -276,7 +288,7 @@ void handle_tab_completion() {
             int filename_len = strlen(filename);
             int chars_to_add = completion_len - filename_len;
             
-            if (chars_to_add > 0 && line_length + chars_to_add < MAX_LINE_LENGTH - 1) {
+            if (chars_to_add > 0) {
                 // Calculate the full path for the match
                 char full_completion[512];
                 if (strcmp(dir, ".") == 0) {
@@ -289,39 +301,24 @@ void handle_tab_completion() {
                 
                 // Check if it's a directory and add trailing slash
                 int is_dir = is_directory(full_completion);
-                if (is_dir) {
-                    if (chars_to_add < MAX_LINE_LENGTH - line_length - 2) {
-                        chars_to_add++;
-                    }
-                }
-                
-                // Make space for the completion
-                memmove(current_line + cursor_pos + chars_to_add, current_line + cursor_pos, line_length - cursor_pos);
                 
-                // Insert the completion
-                memcpy(current_line + word_start + (word_len - filename_len), completion, completion_len);
+                // Insert the rest of the completion
+                gap_insert(&line_buf, cursor_pos, completion + filename_len, chars_to_add);
                 
                 // Add trailing slash for directories
-                if (is_dir && chars_to_add > completion_len - filename_len) {
-                    current_line[word_start + (word_len - filename_len) + completion_len] = '/';
+                if (is_dir) {
+                    gap_insert(&line_buf, cursor_pos + chars_to_add, "/", 1);
+                    chars_to_add++;
                 }
                 
                 line_length += chars_to_add;
                 cursor_pos += chars_to_add;
                 
-                // Reprint from the word start
-                printf("\033[%dD", cursor_pos - word_start - chars_to_add);  // Move to word start
-                for (int i = word_start; i < line_length; i++) {
-                    printf("%c", current_line[i]);
-                }
-                // Move cursor back to correct position
-                if (line_length > cursor_pos) {
-                    printf("\033[%dD", line_length - cursor_pos);
-                }
+                refresh_line();
             }
         } else {
             // Multiple matches - show them
-            printf("\n");
+            render_text("\n", 1);
             for (int i = 0; i < match_count; i++) {
                 // Add visual indicator for directories
                 char display_name[300];
@@ -341,20 +338,13 @@ void handle_tab_completion() {
                     strcpy(display_name, matches[i]);
                 }
                 
-                printf("%-20s", display_name);
-                if ((i + 1) % 4 == 0) printf("\n");  // 4 per line for paths
+                render_printf("%-20s", display_name);
+                if ((i + 1) % 4 == 0) render_text("\n", 1);  // 4 per line for paths
             }
-            if (match_count % 4 != 0) printf("\n");
+            if (match_count % 4 != 0) render_text("\n", 1);
             
             // Reprint prompt and current line
-            print_prompt();
-            for (int i = min_cursor_pos; i < line_length; i++) {
-                printf("%c", current_line[i]);
-            }
-            // Move cursor to correct position
-            if (cursor_pos < line_length) {
-                printf("\033[%dD", line_length - cursor_pos);
-            }
+            redraw_line();
         }
     } else {
         // Command completion (your existing code)
@@ -376,8 +366,7 @@ void handle_tab_completion() {
         }
         
         if (match_count == 0) {
-            printf("\a");
-            fflush(stdout);
+            render_text("\a", 1);
             return;
         }
         
@@ -387,55 +376,34 @@ void handle_tab_completion() {
             int completion_len = strlen(completion);
             int chars_to_add = completion_len - word_len;
             
-            if (chars_to_add > 0 && line_length + chars_to_add < MAX_LINE_LENGTH - 1) {
-                // Make space for the completion
-                memmove(current_line + cursor_pos + chars_to_add, current_line + cursor_pos, line_length - cursor_pos);
-                
-                // Insert the completion
-                memcpy(current_line + word_start, completion, completion_len);
+            if (chars_to_add > 0) {
+                // Insert the rest of the completion
+                gap_insert(&line_buf, cursor_pos, completion + word_len, chars_to_add);
                 
                 // Add a space after the command
                 if (word_start == min_cursor_pos) {  // This is the first word (command)
-                    current_line[word_start + completion_len] = ' ';
+                    gap_insert(&line_buf, cursor_pos + chars_to_add, " ", 1);
                     chars_to_add++;
-                    completion_len++;
                 }
                 
                 line_length += chars_to_add;
                 cursor_pos += chars_to_add;
                 
-                // Reprint from the word start
-                printf("\033[%dD", cursor_pos - word_start - chars_to_add);  // Move to word start
-                for (int i = word_start; i < line_length; i++) {
-                    printf("%c", current_line[i]);
-                }
-                // Move cursor back to correct position
-                if (line_length > cursor_pos) {
-                    printf("\033[%dD", line_length - cursor_pos);
-                }
+                refresh_line();
             }
         } else {
             // Multiple matches - show them
-            printf("\n");
+            render_text("\n", 1);
             for (int i = 0; i < match_count; i++) {
-                printf("%s  ", matches[i]);
-                if ((i + 1) % 8 == 0) printf("\n");  // 8 per line
+                render_printf("%s  ", matches[i]);
+                if ((i + 1) % 8 == 0) render_text("\n", 1);  // 8 per line
             }
-            if (match_count % 8 != 0) printf("\n");
+            if (match_count % 8 != 0) render_text("\n", 1);
             
             // Reprint prompt and current line
-            print_prompt();
-            for (int i = min_cursor_pos; i < line_length; i++) {
-                printf("%c", current_line[i]);
-            }
-            // Move cursor to correct position
-            if (cursor_pos < line_length) {
-                printf("\033[%dD", line_length - cursor_pos);
-            }
+            redraw_line();
         }
     }
-    
-    fflush(stdout);
 }
 
 void handle_printable(int c) {
@@ -450,7 +418,7 @@ void handle_special(int c) {
             switch (c3) {
                 case 'A':  // Up arrow
                     {
-                        char *hist_line = get_history_entry(1);
+                        char *hist_line = get_history_entry(1, gap_text(&line_buf) + min_cursor_pos);
                         if (hist_line) {
                             replace_line(hist_line);
                             free(hist_line);
@@ -459,7 +427,7 @@ void handle_special(int c) {
                     break;
                 case 'B':  // Down arrow
                     {
-                        char *hist_line = get_history_entry(-1);
+                        char *hist_line = get_history_entry(-1, gap_text(&line_buf) + min_cursor_pos);
                         if (hist_line) {
                             replace_line(hist_line);
                             free(hist_line);
@@ -483,6 +451,11 @@ void handle_special(int c) {
                         delete_char();
                     }
                     break;
+                case '2':  // ESC[200~ starts a bracketed paste
+                    if (read_char() == '0' && read_char() == '0' && read_char() == '~') {
+                        handle_paste();
+                    }
+                    break;
             }
         } else if (c2 == 'O') {  // Alternative sequences
             int c3 = read_char();
@@ -500,31 +473,23 @@ void handle_special(int c) {
     } else if (c == 4) {  // Ctrl+D (EOF)
         if (line_length == min_cursor_pos) {
             // Empty line, exit
-            printf("\n");
+            render_text("\n", 1);
+            render_flush();
+            raw_mode_leave();
             exit(0);
         } else {
             delete_char();
         }
     } else if (c == 3) {  // Ctrl+C
-        printf("^C\n");
+        render_text("^C\n", 3);
         // Clear line and start fresh
+        gap_delete(&line_buf, min_cursor_pos, line_length - min_cursor_pos);
         line_length = min_cursor_pos;
         cursor_pos = min_cursor_pos;
-        current_line[line_length] = '\0';
-        print_prompt();
-        fflush(stdout);
+        redraw_line();
     } else if (c == 12) {  // Ctrl+L (clear screen)
-        printf("\033[H\033[2J");  // Clear screen and move to top
-        print_prompt();
-        // Reprint current line
-        for (int i = min_cursor_pos; i < line_length; i++) {
-            printf("%c", current_line[i]);
-        }
-        // Move cursor to correct position
-        if (cursor_pos < line_length) {
-            printf("\033[%dD", line_length - cursor_pos);
-        }
-        fflush(stdout);
+        render_text("\033[H\033[2J", 7);  // Clear screen and move to top
+        redraw_line();
     }
 }
 
@@ -539,9 +504,8 @@ void handle_char(int c) {
 }
 
 char *promptly_loop() {
-    size_t max_chars = MAX_LINE_LENGTH;
-    current_line = malloc(max_chars);
-    memset(current_line, 0, max_chars);
+    // Grows with the line: no limit on its length
+    gap_init(&line_buf);
     
     // Don't call print_prompt here - it should be called by the shell before this function
     
@@ -550,14 +514,27 @@ char *promptly_loop() {
     cursor_pos = min_cursor_pos;
     line_length = min_cursor_pos;
     
+    // Raw for the whole line rather than around every key
+    raw_mode_enter();
+    render_reset(prompt_columns);
+    
     for (;;) {
         int c = read_char();
         
+        if (c == EOF) {  // Terminal gone: as if Ctrl+D on an empty line
+            render_text("\n", 1);
+            render_flush();
+            raw_mode_leave();
+            exit(0);
+        }
+        
         if (c == '\n' || c == '\r') {  // Enter pressed
-            printf("\n");
+            render_text("\n", 1);
+            render_flush();
+            raw_mode_leave();
             
             // Extract the actual command (after prompt)
-            char *command = current_line + min_cursor_pos;
+            char *command = gap_text(&line_buf) + min_cursor_pos;
             int cmd_len = line_length - min_cursor_pos;
             
             // Trim whitespace
@@ -580,7 +557,7 @@ char *promptly_loop() {
             char *result = malloc(cmd_len + 1);
             strcpy(result, command);
             
-            free(current_line);
+            gap_free(&line_buf);
             if (temp_line) {
                 free(temp_line);
                 temp_line = NULL;
@@ -590,6 +567,11 @@ char *promptly_loop() {
         }
         
         handle_char(c);
+        
+        // One write for everything the keys read so far changed
+        if (!input_pending()) {
+            render_flush();
+        }
     }
 }
 
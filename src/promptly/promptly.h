@@ -1,14 +1,14 @@
 #ifndef PROMPTLY_H
 #define PROMPTLY_H
 
-#define MAX_LINE_LENGTH 1024
-
 #include <stddef.h>
 
 // Function declarations from promptly.c
 char *promptly_loop();
 int read_char(void);
 void insert_char(char c);
+void insert_text(const char *text, size_t len);
+void refresh_line(void);
 void delete_char();
 void backspace_char();
 void replace_line(const char *new_content);
@@ -23,20 +23,29 @@ void print_prompt();
 // Function declarations from history.c
 void init_history();
 void add_to_history(const char *line);
-char *get_history_entry(int direction);
+char *get_history_entry(int direction, const char *line);
 void cleanup_history();
 
 // Function declarations from cursor.c
-void move_cursor_left(int n);
-void move_cursor_right(int n);
-void clear_line_from_cursor();
-void save_cursor_pos();
-void restore_cursor_pos();
 void cursor_left();
 void cursor_right();
 void cursor_home();
 void cursor_end();
 
+// Function declarations from terminal.c
+void raw_mode_enter(void);
+void raw_mode_leave(void);
+int read_byte(void);
+int input_pending(void);
+
+// Function declarations from render.c
+void render_reset(int column);
+void render_line(const char *before, int before_len, const char *after,
+                 int after_len, int cursor);
+void render_text(const char *text, size_t len);
+void render_printf(const char *format, ...);
+void render_flush(void);
+
 // Function declarations from config.c
 void init_config();
 int load_config();
@@ -44,7 +53,6 @@ int save_config();
 const char* get_color(const char* color_code);
 
 // Global variables
-extern char *current_line;
 extern int line_length;
 extern int cursor_pos;
 extern int min_cursor_pos;
@@ -0,0 +1,282 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "render.h"
+
+// What the screen shows after the prompt, and where the cursor is in it
+static char *shown = NULL;
+static int shown_len = 0;
+static int shown_cap = 0;
+static int shown_cursor = 0;
+
+// Column the line starts at, after the prompt, and the terminal's width;
+// 0 when it isn't known, and the line is taken to be one endless row
+static int start_column = 0;
+static int width = 0;
+static volatile sig_atomic_t width_stale = 1;
+
+// Output not yet written
+static char *out = NULL;
+static size_t out_len = 0;
+static size_t out_cap = 0;
+
+static void *grow(void *p, size_t size) {
+    p = realloc(p, size);
+    if (!p) {
+        perror("realloc");
+        exit(1);
+    }
+    return p;
+}
+
+void render_text(const char *text, size_t len) {
+    if (out_len + len > out_cap) {
+        out_cap = out_cap ? out_cap : 256;
+        while (out_len + len > out_cap)
+            out_cap *= 2;
+        out = grow(out, out_cap);
+    }
+    memcpy(out + out_len, text, len);
+    out_len += len;
+}
+
+void render_printf(const char *format, ...) {
+    char buf[512];
+    va_list ap;
+
+    va_start(ap, format);
+    int n = vsnprintf(buf, sizeof(buf), format, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+    if ((size_t)n < sizeof(buf)) {
+        render_text(buf, n);
+        return;
+    }
+
+    char *big = grow(NULL, n + 1);
+    va_start(ap, format);
+    vsnprintf(big, n + 1, format, ap);
+    va_end(ap);
+    render_text(big, n);
+    free(big);
+}
+
+// Anything printed through stdio goes out first, so the order holds
+void render_flush(void) {
+    fflush(stdout);
+
+    const char *p = out;
+    while (out_len > 0) {
+        ssize_t n = write(STDOUT_FILENO, p, out_len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        p += n;
+        out_len -= n;
+    }
+    out_len = 0;
+}
+
+static void note_resize(int sig) {
+    (void)sig;
+    width_stale = 1;
+}
+
+// The width is read again only after SIGWINCH says it changed
+static void update_width(void) {
+    static int watching = 0;
+    if (!watching) {
+        struct sigaction sa;
+        sa.sa_handler = note_resize;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGWINCH, &sa, NULL);
+        watching = 1;
+    }
+    if (!width_stale)
+        return;
+    width_stale = 0;
+
+    struct winsize ws;
+    width = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 ? ws.ws_col : 0;
+}
+
+// A prompt `column` cells wide has just been printed: nothing of the
+// line is on screen
+void render_reset(int column) {
+    shown_len = 0;
+    shown_cursor = 0;
+    start_column = column;
+}
+
+static int row_of(int cell) {
+    return width ? (start_column + cell) / width : 0;
+}
+
+static int column_of(int cell) {
+    return width ? (start_column + cell) % width : start_column + cell;
+}
+
+// One column per byte
+static void put_cells(const char *text, int len) {
+    for (int i = 0; i < len; i++) {
+        if (text[i] == '\n') {
+            render_text("↵", 3);
+        } else if (text[i] == '\t') {
+            render_text(" ", 1);
+        } else {
+            render_text(&text[i], 1);
+        }
+    }
+}
+
+static void move_to(int cell) {
+    int rows = row_of(cell) - row_of(shown_cursor);
+    if (rows == -1) {
+        render_text("\033[A", 3);
+    } else if (rows < 0) {
+        render_printf("\033[%dA", -rows);
+    } else if (rows == 1) {
+        render_text("\033[B", 3);
+    } else if (rows > 0) {
+        render_printf("\033[%dB", rows);
+    }
+
+    int n = column_of(cell) - column_of(shown_cursor);
+    if (n == -1) {
+        render_text("\033[D", 3);
+    } else if (n < 0) {
+        render_printf("\033[%dD", -n);
+    } else if (n == 1) {
+        render_text("\033[C", 3);
+    } else if (n > 0) {
+        render_printf("\033[%dC", n);
+    }
+    shown_cursor = cell;
+}
+
+// Text just written, ending at `cell`, filled its last row: the terminal
+// holds the cursor on the last column until something more is printed,
+// so take it to the start of the next row, where the model has it
+static void wrap_cursor(int cell) {
+    if (width && cell > 0 && column_of(cell) == 0)
+        render_text("\r\n", 2);
+}
+
+// How many bytes s and t agree on from the start, and from the end.  On
+// a long line nearly all of it matches, so whole blocks are checked with
+// memcmp first.
+#define MATCH_BLOCK 256
+
+static int match_forward(const char *s, const char *t, int n) {
+    int i = 0;
+    while (i + MATCH_BLOCK <= n && memcmp(s + i, t + i, MATCH_BLOCK) == 0)
+        i += MATCH_BLOCK;
+    while (i < n && s[i] == t[i])
+        i++;
+    return i;
+}
+
+static int match_backward(const char *s_end, const char *t_end, int n) {
+    int i = 0;
+    while (i + MATCH_BLOCK <= n &&
+           memcmp(s_end - i - MATCH_BLOCK, t_end - i - MATCH_BLOCK, MATCH_BLOCK) == 0)
+        i += MATCH_BLOCK;
+    while (i < n && s_end[-1 - i] == t_end[-1 - i])
+        i++;
+    return i;
+}
+
+static int min_int(int a, int b) {
+    return a < b ? a : b;
+}
+
+// Cells from..from+n of the line held as before + after
+static void put_range(const char *before, int before_len, const char *after,
+                      int from, int n) {
+    if (from < before_len) {
+        int k = min_int(n, before_len - from);
+        put_cells(before + from, k);
+        from += k;
+        n -= k;
+    }
+    put_cells(after + from - before_len, n);
+}
+
+void render_line(const char *before, int before_len, const char *after,
+                 int after_len, int cursor) {
+    int len = before_len + after_len;
+    update_width();
+
+    // The part that changed lies between what is the same at the start
+    // and what is the same at the end.  A key typed into a run of equal
+    // bytes fits anywhere along it, so the start stops at the cursor and
+    // the change is drawn where the cursor already is.
+    int limit = min_int(len, shown_len);
+    int start_limit = min_int(limit, min_int(shown_cursor, cursor));
+    int same_start = match_forward(before, shown,
+                                   min_int(before_len, start_limit));
+    if (same_start == before_len)
+        same_start += match_forward(after, shown + before_len,
+                                    min_int(after_len, start_limit - before_len));
+
+    limit -= same_start;
+    int same_end = match_backward(after + after_len, shown + shown_len,
+                                  min_int(after_len, limit));
+    if (same_end == after_len)
+        same_end += match_backward(before + before_len,
+                                   shown + shown_len - after_len,
+                                   min_int(before_len, limit - after_len));
+
+    int old_mid = shown_len - same_start - same_end;
+    int new_mid = len - same_start - same_end;
+
+    // Inserting and deleting characters only moves the rest of the row
+    // they are on, so once the line wraps a change in length reprints
+    // everything after it instead
+    int longest = len > shown_len ? len : shown_len;
+    int one_row = !width || start_column + longest < width;
+
+    if ((old_mid > 0 || new_mid > 0) && (one_row || new_mid == old_mid)) {
+        move_to(same_start);
+        // Make room for new text in front of an unchanged tail, or close
+        // up behind it; the terminal moves the tail itself
+        if (new_mid > old_mid && same_end > 0)
+            render_printf("\033[%d@", new_mid - old_mid);
+        put_range(before, before_len, after, same_start, new_mid);
+        shown_cursor = same_start + new_mid;
+        if (new_mid > 0)
+            wrap_cursor(shown_cursor);
+        if (old_mid > new_mid && same_end > 0) {
+            render_printf("\033[%dP", old_mid - new_mid);
+        } else if (old_mid > new_mid) {
+            render_text("\033[K", 3);
+        }
+    } else if (old_mid > 0 || new_mid > 0) {
+        move_to(same_start);
+        put_range(before, before_len, after, same_start, len - same_start);
+        shown_cursor = len;
+        if (len > same_start)
+            wrap_cursor(len);
+        if (shown_len > len)
+            render_text("\033[J", 3);
+    }
+    move_to(cursor);
+
+    if (len > shown_cap) {
+        shown_cap = len * 2;
+        shown = grow(shown, shown_cap);
+    }
+    memcpy(shown, before, before_len);
+    memcpy(shown + before_len, after, after_len);
+    shown_len = len;
+}
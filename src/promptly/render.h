@@ -0,0 +1,25 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stddef.h>
+
+// Everything promptly writes to the terminal is collected here and sent
+// with one write() per flush. The line being edited is drawn by
+// render_line(), which keeps a copy of what is on screen and only sends
+// the difference: a key typed in the middle of a long line costs a few
+// bytes, not a reprint of the rest of it.
+//
+// The model places the line right after the prompt, one column per
+// byte, wrapping at the terminal's width; a newline shows as a return
+// arrow and a tab as a space.  The prompt is taken to start a row.  The
+// line is passed as the two halves of the gap buffer that holds it, so
+// it never has to be made contiguous to draw.
+
+void render_reset(int column);
+void render_line(const char *before, int before_len, const char *after,
+                 int after_len, int cursor);
+void render_text(const char *text, size_t len);
+void render_printf(const char *format, ...);
+void render_flush(void);
+
+#endif
@@ -0,0 +1,104 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "terminal.h"
+
+static struct termios saved_modes;
+static volatile sig_atomic_t raw_active = 0;
+static int handlers_installed = 0;
+
+// Bytes read but not yet handed out.  Anything typed ahead after Enter
+// stays here for the next prompt.
+static unsigned char input[TERMINAL_READ_SIZE];
+static size_t input_pos = 0;
+static size_t input_len = 0;
+
+// Asks the terminal to mark pastes with ESC[200~ ... ESC[201~
+static const char paste_on[] = "\033[?2004h";
+static const char paste_off[] = "\033[?2004l";
+static int paste_mode = 0;
+
+static void restore_modes(void) {
+    if (raw_active) {
+        if (paste_mode) {
+            write(STDOUT_FILENO, paste_off, sizeof(paste_off) - 1);
+        }
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &saved_modes);
+        raw_active = 0;
+    }
+}
+
+// A signal that ends the shell must not leave the terminal raw
+static void fatal_signal_handler(int sig) {
+    restore_modes();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void install_handlers(void) {
+    static const int fatal[] = {SIGHUP, SIGTERM, SIGQUIT};
+
+    for (size_t i = 0; i < sizeof(fatal) / sizeof(fatal[0]); i++) {
+        struct sigaction old;
+        // Leave alone anything the shell already ignores or handles
+        if (sigaction(fatal[i], NULL, &old) == 0 && old.sa_handler == SIG_DFL)
+            signal(fatal[i], fatal_signal_handler);
+    }
+    atexit(restore_modes);
+    handlers_installed = 1;
+}
+
+void raw_mode_enter(void) {
+    if (raw_active)
+        return;
+    if (tcgetattr(STDIN_FILENO, &saved_modes) < 0)
+        return;  // not a terminal: bytes are read as they come
+
+    if (!handlers_installed)
+        install_handlers();
+
+    struct termios raw = saved_modes;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    // CR arrives as itself, so a pasted CRLF isn't turned into two newlines
+    raw.c_iflag &= ~ICRNL;
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) < 0)
+        return;
+    raw_active = 1;
+
+    // A terminal that doesn't know the mode just ignores the request
+    const char *term = getenv("TERM");
+    paste_mode = isatty(STDOUT_FILENO) && !(term && strcmp(term, "dumb") == 0);
+    if (paste_mode) {
+        fflush(stdout);
+        write(STDOUT_FILENO, paste_on, sizeof(paste_on) - 1);
+    }
+}
+
+void raw_mode_leave(void) {
+    fflush(stdout);
+    restore_modes();
+}
+
+int input_pending(void) {
+    return input_pos < input_len;
+}
+
+int read_byte(void) {
+    while (input_pos == input_len) {
+        ssize_t n = read(STDIN_FILENO, input, sizeof(input));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return EOF;
+        input_pos = 0;
+        input_len = (size_t)n;
+    }
+    return input[input_pos++];
+}
@@ -0,0 +1,20 @@
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+// Size of the buffer keys are decoded from
+#define TERMINAL_READ_SIZE 4096
+
+// The terminal is put in raw mode once per line read, and the caller's
+// modes are put back when the line is done, on exit, or on a signal
+// that ends the shell.
+void raw_mode_enter(void);
+void raw_mode_leave(void);
+
+// The next input byte, read in blocks of up to TERMINAL_READ_SIZE.
+// Returns EOF at end of input or on a read error.
+int read_byte(void);
+
+// Whether bytes are already buffered, so the screen can wait for them
+int input_pending(void);
+
+#endif
@@ -0,0 +1,274 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "job_control.h"
+#include "reaper.h"
+#include "signal_handlers.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#define REAPER_SIGNALFD 1
+#else
+#include <sys/select.h>
+#define REAPER_SIGNALFD 0
+#endif
+
+typedef struct ReapEntry {
+  struct ReapEntry *next;
+  pid_t pid;
+  process *p;   /* job process to update, or NULL */
+  int status;
+  int reported; /* status holds an exit nobody has claimed yet */
+} ReapEntry;
+
+static ReapEntry *buckets[REAPER_BUCKETS];
+static int ready = 0;
+static sigset_t saved_mask; /* the mask from before SIGCHLD was blocked */
+#if REAPER_SIGNALFD
+static int sig_fd = -1;
+static int epoll_fd = -1;
+#endif
+
+static void noop_handler(int sig) { (void)sig; }
+
+/* Block SIGCHLD and set up the descriptor it is read from.  Called by
+   every entry point, so a shell that never forks never pays for it.  */
+void reaper_init(void) {
+  if (ready)
+    return;
+  ready = 1;
+
+  sigset_t chld;
+  sigemptyset(&chld);
+  sigaddset(&chld, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &chld, &saved_mask);
+
+  // Only for pselect(), which needs a handler to return early; stops
+  // must still raise SIGCHLD, so no SA_NOCLDSTOP
+  struct sigaction sa;
+  sa.sa_handler = noop_handler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGCHLD, &sa, NULL);
+
+#if REAPER_SIGNALFD
+  sig_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ev = {.events = EPOLLIN};
+  if (sig_fd < 0 || epoll_fd < 0 ||
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sig_fd, &ev) < 0) {
+    // Fall back to pselect()
+    if (sig_fd >= 0)
+      close(sig_fd);
+    if (epoll_fd >= 0)
+      close(epoll_fd);
+    sig_fd = epoll_fd = -1;
+  }
+#endif
+}
+
+/* Give SIGCHLD back before a command is exec'd, in a child mu_fork()
+   made or in place of the shell.  Nothing is forgotten, so a failed exec
+   carries on where it left off; the next call sets things up again.  */
+void reaper_reset(void) {
+  if (!ready)
+    return;
+  ready = 0;
+
+#if REAPER_SIGNALFD
+  if (sig_fd >= 0)
+    close(sig_fd);
+  if (epoll_fd >= 0)
+    close(epoll_fd);
+  sig_fd = epoll_fd = -1;
+#endif
+  signal(SIGCHLD, SIG_DFL);
+  sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+}
+
+/* In a forked child: the parent's children aren't ours to wait for.  */
+void reaper_forget(void) {
+  for (int i = 0; i < REAPER_BUCKETS; i++) {
+    ReapEntry *e = buckets[i];
+    while (e) {
+      ReapEntry *next = e->next;
+      free(e);
+      e = next;
+    }
+    buckets[i] = NULL;
+  }
+}
+
+static ReapEntry **slot(pid_t pid) {
+  ReapEntry **e = &buckets[(unsigned)pid % REAPER_BUCKETS];
+  while (*e && (*e)->pid != pid)
+    e = &(*e)->next;
+  return e;
+}
+
+static ReapEntry *add(pid_t pid) {
+  ReapEntry **e = slot(pid);
+  if (!*e) {
+    *e = calloc(1, sizeof(ReapEntry));
+    if (!*e) {
+      perror("calloc");
+      exit(1);
+    }
+    (*e)->pid = pid;
+  }
+  return *e;
+}
+
+static void drop(ReapEntry **e) {
+  ReapEntry *dead = *e;
+  *e = dead->next;
+  free(dead);
+}
+
+/* Hand one status from waitpid() to whoever is expecting it.  */
+static void record(pid_t pid, int status) {
+  ReapEntry **e = slot(pid);
+
+  if (*e && (*e)->p) {
+    mark_process_status((*e)->p, status);
+    job_notification_pending = 1;
+    if (!WIFSTOPPED(status))
+      drop(e);
+    return;
+  }
+
+  // Nobody is waiting on a stopped child that isn't a job's
+  if (WIFSTOPPED(status))
+    return;
+  ReapEntry *entry = add(pid);
+  entry->status = status;
+  entry->reported = 1;
+}
+
+/* Collect everything waitpid() has ready.  Returns how many statuses,
+   or -1 if there are no children at all.  */
+static int drain(void) {
+  int count = 0, status;
+  pid_t pid;
+
+  while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) != 0) {
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != ECHILD)
+        perror("waitpid");
+      return count ? count : -1;
+    }
+    record(pid, status);
+    count++;
+  }
+  return count;
+}
+
+/* Sleep until SIGCHLD arrives or timeout_ms passes (-1: no limit).  */
+static void wait_event(int timeout_ms) {
+#if REAPER_SIGNALFD
+  if (epoll_fd >= 0) {
+    struct epoll_event ev;
+    if (epoll_wait(epoll_fd, &ev, 1, timeout_ms) > 0) {
+      struct signalfd_siginfo info[16];
+      while (read(sig_fd, info, sizeof(info)) > 0)
+        ;
+    }
+    return;
+  }
+#endif
+  sigset_t mask = saved_mask;
+  sigdelset(&mask, SIGCHLD);
+  struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+  pselect(0, NULL, NULL, NULL, timeout_ms < 0 ? NULL : &ts, &mask);
+}
+
+/* Route any child status changes to their job processes, waiting up to
+   timeout_ms (-1: until there is one, 0: not at all).  Returns the
+   number of changes, or -1 if the shell has no children left.  */
+int reaper_poll(int timeout_ms) {
+  reaper_init();
+
+  int n = drain();
+  if (n != 0 || timeout_ms == 0)
+    return n;
+  wait_event(timeout_ms);
+  return drain();
+}
+
+/* Have status changes of pid update p.  Its exit may already have been
+   collected while another wait was going on.  */
+void reaper_track(pid_t pid, process *p) {
+  reaper_init();
+
+  ReapEntry **e = slot(pid);
+  if (*e && (*e)->reported) {
+    mark_process_status(p, (*e)->status);
+    job_notification_pending = 1;
+    drop(e);
+    return;
+  }
+  add(pid)->p = p;
+}
+
+void reaper_untrack(pid_t pid) {
+  ReapEntry **e = slot(pid);
+  if (*e)
+    drop(e);
+}
+
+/* Block until `which` (a pid, or -pgid for a whole job) changes state
+   and route the status, for a wait whose target is known; one waitpid()
+   then does.  Returns -1 if there is no such child.  */
+int reaper_wait(pid_t which) {
+  reaper_init();
+
+  int status;
+  pid_t pid;
+  while ((pid = waitpid(which, &status, WUNTRACED)) < 0)
+    if (errno != EINTR)
+      return -1;
+  record(pid, status);
+  return 1;
+}
+
+/* Block until the child pid exits, for callers outside job control.
+   Returns -1 if pid isn't a child of this process.  */
+int reaper_wait_pid(pid_t pid, int *status) {
+  reaper_init();
+
+  // Collected already by a wait for everything
+  ReapEntry **e = slot(pid);
+  if (*e && (*e)->reported) {
+    *status = (*e)->status;
+    drop(e);
+    return 0;
+  }
+
+  while (waitpid(pid, status, 0) < 0)
+    if (errno != EINTR)
+      return -1;
+  return 0;
+}
+
+/* A descriptor that turns readable once the child pid has exited, for
+   waiting on particular children with poll().  It doesn't collect the
+   status; that is still done here.  Returns -1 where there are no
+   pidfds.  */
+int reaper_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+  (void)pid;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
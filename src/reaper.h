@@ -0,0 +1,26 @@
+#ifndef REAPER_H
+#define REAPER_H
+
+#include <sys/types.h>
+
+#include "process.h"
+
+// The one place the shell reaps its children. SIGCHLD stays blocked and
+// is read from a signalfd through epoll on Linux, or waited for with
+// pselect() elsewhere, so no handler calls waitpid() behind the main
+// flow's back. Each status goes straight to the job process registered
+// for its pid, or is kept until reaper_wait_pid() claims it.
+
+#define REAPER_BUCKETS 256
+
+void reaper_init(void);
+void reaper_reset(void);
+void reaper_forget(void);
+void reaper_track(pid_t pid, process *p);
+void reaper_untrack(pid_t pid);
+int reaper_poll(int timeout_ms);
+int reaper_wait(pid_t which);
+int reaper_wait_pid(pid_t pid, int *status);
+int reaper_pidfd(pid_t pid);
+
+#endif
@@ -0,0 +1,192 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "expand.h"
+#include "redirect.h"
+
+#define NOT_SAVED -2
+
+static int open_flags(NodeType type) {
+  switch (type) {
+  case NODE_READ:
+    return O_RDONLY;
+  case NODE_WRITE:
+  case NODE_ERR:
+  case NODE_WRITE_ERR:
+    return O_WRONLY | O_CREAT | O_TRUNC;
+  case NODE_APPEND:
+    return O_WRONLY | O_CREAT | O_APPEND;
+  case NODE_READWRITE:
+    return O_RDWR | O_CREAT;
+  default:
+    return -1;
+  }
+}
+
+/* Expand the targets of a command's redirections into a plan.  Returns
+   NULL after printing an error if one of them is malformed.  */
+RedirPlan *redir_plan_new(Redirection *redirs) {
+  int count = 0;
+  for (Redirection *r = redirs; r; r = r->next)
+    count++;
+
+  RedirPlan *plan = calloc(1, sizeof(RedirPlan));
+  if (!plan || !(plan->ops = calloc(count ? count : 1, sizeof(RedirOp)))) {
+    perror("calloc");
+    exit(1);
+  }
+
+  for (Redirection *r = redirs; r; r = r->next) {
+    RedirOp *op = &plan->ops[plan->count++];
+    op->fd = r->fd;
+    op->src = -1;
+    op->saved = NOT_SAVED;
+    if (op->fd > 2)
+      plan->names_fds = 1;
+
+    char *target = expand_word(&r->target);
+
+    if (target[0] != '&') {
+      op->kind = REDIR_FILE;
+      op->path = target;
+      op->flags = open_flags(r->type);
+      if (op->flags == -1) {
+        fprintf(stderr, "Unknown redirection type\n");
+        redir_plan_free(plan);
+        return NULL;
+      }
+      continue;
+    }
+
+    // &N duplicates descriptor N, &- closes
+    plan->names_fds = 1;
+    if (strcmp(target, "&-") == 0) {
+      op->kind = REDIR_CLOSE;
+    } else if (isdigit((unsigned char)target[1])) {
+      op->kind = REDIR_DUP;
+      op->src = atoi(target + 1);
+    } else {
+      fprintf(stderr, "Invalid redirection target: %s\n", target);
+      free(target);
+      redir_plan_free(plan);
+      return NULL;
+    }
+    free(target);
+  }
+  return plan;
+}
+
+/* Open the plan's files in the shell, close-on-exec, unless they already
+   are.  Returns 1 after printing an error if one can't be opened; none
+   are left open then.  */
+int redir_plan_open(RedirPlan *plan) {
+  for (int i = 0; i < plan->count; i++) {
+    RedirOp *op = &plan->ops[i];
+    if (op->kind != REDIR_FILE || op->src >= 0)
+      continue;
+
+    int fd = open(op->path, op->flags | O_CLOEXEC, 0644);
+    if (fd == -1) {
+      perror(op->path);
+      redir_plan_close(plan);
+      return 1;
+    }
+
+    // Keep clear of low descriptors the command names itself (3>&-)
+    if (plan->names_fds && fd < 10) {
+      int high = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+      if (high >= 0) {
+        close(fd);
+        fd = high;
+      }
+    }
+    op->src = fd;
+  }
+  return 0;
+}
+
+static int saved_earlier(const RedirPlan *plan, int upto, int fd) {
+  for (int i = 0; i < upto; i++)
+    if (plan->ops[i].fd == fd)
+      return 1;
+  return 0;
+}
+
+/* Put the opened plan into effect on this process.  With `save`, each
+   descriptor it replaces is copied first so redir_plan_restore() can put
+   it back, which builtins need; children that are about to exec don't.
+   Returns 1 after printing an error; what was done so far stays done.  */
+int redir_plan_apply(RedirPlan *plan, int save) {
+  for (int i = 0; i < plan->count; i++) {
+    RedirOp *op = &plan->ops[i];
+
+    // -1 records that the descriptor was closed to begin with
+    if (save && !saved_earlier(plan, i, op->fd))
+      op->saved = fcntl(op->fd, F_DUPFD_CLOEXEC, 10);
+
+    if (op->kind == REDIR_CLOSE) {
+      close(op->fd);
+    } else if (op->src == op->fd) {
+      // The file landed on its own descriptor: just keep it across exec
+      fcntl(op->fd, F_SETFD, 0);
+    } else if (dup2(op->src, op->fd) == -1) {
+      fprintf(stderr, "mu: %d: %s\n", op->src, strerror(errno));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Undo redir_plan_apply(plan, 1), last redirection first.  */
+void redir_plan_restore(RedirPlan *plan) {
+  for (int i = plan->count - 1; i >= 0; i--) {
+    RedirOp *op = &plan->ops[i];
+    if (op->saved == NOT_SAVED)
+      continue;
+    if (op->saved >= 0) {
+      dup2(op->saved, op->fd);
+      close(op->saved);
+    } else {
+      close(op->fd);
+    }
+    op->saved = NOT_SAVED;
+  }
+}
+
+/* The same redirections as file actions, to follow any pipe dups.  */
+void redir_plan_add_actions(const RedirPlan *plan,
+                            posix_spawn_file_actions_t *actions) {
+  for (int i = 0; i < plan->count; i++) {
+    const RedirOp *op = &plan->ops[i];
+    if (op->kind == REDIR_CLOSE)
+      posix_spawn_file_actions_addclose(actions, op->fd);
+    else
+      posix_spawn_file_actions_adddup2(actions, op->src, op->fd);
+  }
+}
+
+/* Close the shell's copies of the opened files.  */
+void redir_plan_close(RedirPlan *plan) {
+  for (int i = 0; i < plan->count; i++) {
+    RedirOp *op = &plan->ops[i];
+    if (op->kind == REDIR_FILE && op->src >= 0) {
+      close(op->src);
+      op->src = -1;
+    }
+  }
+}
+
+void redir_plan_free(RedirPlan *plan) {
+  if (!plan)
+    return;
+  redir_plan_close(plan);
+  for (int i = 0; i < plan->count; i++)
+    free(plan->ops[i].path);
+  free(plan->ops);
+  free(plan);
+}
@@ -0,0 +1,40 @@
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+#include <spawn.h>
+
+#include "tokenizer.h"
+
+// A command's redirections with their targets expanded, ready to be
+// carried out in a forked child, as posix_spawn file actions, or around a
+// builtin in the shell. The shell opens the files itself (close-on-exec)
+// so an error names the file however the command is started; the child
+// then only dup2()s them into place.
+
+typedef enum { REDIR_FILE, REDIR_DUP, REDIR_CLOSE } RedirKind;
+
+typedef struct RedirOp {
+  RedirKind kind;
+  int fd;     /* descriptor the command sees */
+  int src;    /* REDIR_DUP: fd to copy; REDIR_FILE: the opened file */
+  int flags;  /* REDIR_FILE: open() flags */
+  char *path; /* REDIR_FILE */
+  int saved;  /* copy of fd from before the plan ran in the shell */
+} RedirOp;
+
+typedef struct RedirPlan {
+  RedirOp *ops;
+  int count;
+  int names_fds; /* refers to descriptors by number, beyond 0-2 */
+} RedirPlan;
+
+RedirPlan *redir_plan_new(Redirection *redirs);
+int redir_plan_open(RedirPlan *plan);
+int redir_plan_apply(RedirPlan *plan, int save);
+void redir_plan_restore(RedirPlan *plan);
+void redir_plan_add_actions(const RedirPlan *plan,
+                            posix_spawn_file_actions_t *actions);
+void redir_plan_close(RedirPlan *plan);
+void redir_plan_free(RedirPlan *plan);
+
+#endif
@@ -0,0 +1,173 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+typedef const char *(*scan_fn)(const char *p, const char *end);
+
+static scan_fn word_impl = NULL;
+static scan_fn dquote_impl = NULL;
+
+// Bytes that end an unquoted word or change how it is read
+static const unsigned char word_special[256] = {
+    ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1, [' '] = 1,
+    [';'] = 1,  ['|'] = 1,  ['('] = 1,  [')'] = 1,  ['!'] = 1,  ['&'] = 1,
+    ['<'] = 1,  ['>'] = 1,  ['\''] = 1, ['"'] = 1,  ['\\'] = 1, ['$'] = 1,
+};
+
+static const unsigned char dquote_special[256] = {
+    ['"'] = 1,
+    ['\\'] = 1,
+    ['$'] = 1,
+};
+
+static const char *scan_word_scalar(const char *p, const char *end) {
+  while (p < end && !word_special[(unsigned char)*p])
+    p++;
+  return p;
+}
+
+static const char *scan_dquote_scalar(const char *p, const char *end) {
+  while (p < end && !dquote_special[(unsigned char)*p])
+    p++;
+  return p;
+}
+
+#ifdef SCAN_X86
+
+/* Lanes of v equal to c, or within [lo, lo + span] as unsigned bytes.  */
+#define EQ128(v, c) _mm_cmpeq_epi8((v), _mm_set1_epi8(c))
+#define RANGE128(v, lo, span)                                                  \
+  _mm_cmpeq_epi8(_mm_min_epu8(_mm_sub_epi8((v), _mm_set1_epi8(lo)),            \
+                              _mm_set1_epi8(span)),                            \
+                 _mm_sub_epi8((v), _mm_set1_epi8(lo)))
+#define EQ256(v, c) _mm256_cmpeq_epi8((v), _mm256_set1_epi8(c))
+#define RANGE256(v, lo, span)                                                  \
+  _mm256_cmpeq_epi8(_mm256_min_epu8(_mm256_sub_epi8((v), _mm256_set1_epi8(lo)), \
+                                    _mm256_set1_epi8(span)),                   \
+                    _mm256_sub_epi8((v), _mm256_set1_epi8(lo)))
+
+__attribute__((target("sse2"))) static const char *
+scan_word_sse2(const char *p, const char *end) {
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    // \t..\r, ' '..'"', '&'..')', ';'..'<', then the loners
+    __m128i m = _mm_or_si128(RANGE128(v, '\t', 4), RANGE128(v, ' ', 2));
+    m = _mm_or_si128(m, RANGE128(v, '&', 3));
+    m = _mm_or_si128(m, RANGE128(v, ';', 1));
+    m = _mm_or_si128(m, _mm_or_si128(EQ128(v, '$'), EQ128(v, '>')));
+    m = _mm_or_si128(m, _mm_or_si128(EQ128(v, '\\'), EQ128(v, '|')));
+
+    int bits = _mm_movemask_epi8(m);
+    if (bits)
+      return p + __builtin_ctz(bits);
+    p += 16;
+  }
+  return scan_word_scalar(p, end);
+}
+
+__attribute__((target("sse2"))) static const char *
+scan_dquote_sse2(const char *p, const char *end) {
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i m = _mm_or_si128(EQ128(v, '"'), EQ128(v, '\\'));
+    m = _mm_or_si128(m, EQ128(v, '$'));
+
+    int bits = _mm_movemask_epi8(m);
+    if (bits)
+      return p + __builtin_ctz(bits);
+    p += 16;
+  }
+  return scan_dquote_scalar(p, end);
+}
+
+__attribute__((target("avx2"))) static const char *
+scan_word_avx2(const char *p, const char *end) {
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i m = _mm256_or_si256(RANGE256(v, '\t', 4), RANGE256(v, ' ', 2));
+    m = _mm256_or_si256(m, RANGE256(v, '&', 3));
+    m = _mm256_or_si256(m, RANGE256(v, ';', 1));
+    m = _mm256_or_si256(m, _mm256_or_si256(EQ256(v, '$'), EQ256(v, '>')));
+    m = _mm256_or_si256(m, _mm256_or_si256(EQ256(v, '\\'), EQ256(v, '|')));
+
+    unsigned bits = (unsigned)_mm256_movemask_epi8(m);
+    if (bits)
+      return p + __builtin_ctz(bits);
+    p += 32;
+  }
+  return scan_word_sse2(p, end);
+}
+
+__attribute__((target("avx2"))) static const char *
+scan_dquote_avx2(const char *p, const char *end) {
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i m = _mm256_or_si256(EQ256(v, '"'), EQ256(v, '\\'));
+    m = _mm256_or_si256(m, EQ256(v, '$'));
+
+    unsigned bits = (unsigned)_mm256_movemask_epi8(m);
+    if (bits)
+      return p + __builtin_ctz(bits);
+    p += 32;
+  }
+  return scan_dquote_sse2(p, end);
+}
+
+#endif /* SCAN_X86 */
+
+/* Pick the widest implementation this CPU supports.  */
+static void scan_init(void) {
+  word_impl = scan_word_scalar;
+  dquote_impl = scan_dquote_scalar;
+
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    word_impl = scan_word_avx2;
+    dquote_impl = scan_dquote_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    word_impl = scan_word_sse2;
+    dquote_impl = scan_dquote_sse2;
+  }
+#endif
+}
+
+int scan_select(const char *name) {
+  if (strcmp(name, "scalar") == 0) {
+    word_impl = scan_word_scalar;
+    dquote_impl = scan_dquote_scalar;
+    return 0;
+  }
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+    word_impl = scan_word_sse2;
+    dquote_impl = scan_dquote_sse2;
+    return 0;
+  }
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+    word_impl = scan_word_avx2;
+    dquote_impl = scan_dquote_avx2;
+    return 0;
+  }
+#endif
+  return -1;
+}
+
+const char *scan_word_special(const char *p, const char *end) {
+  if (!word_impl)
+    scan_init();
+  return word_impl(p, end);
+}
+
+const char *scan_dquote_special(const char *p, const char *end) {
+  if (!dquote_impl)
+    scan_init();
+  return dquote_impl(p, end);
+}
@@ -0,0 +1,18 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// Byte scanners for the tokenizer. Each returns a pointer to the first byte
+// in [p, end) that the tokenizer has to look at, or `end` if there is none.
+// SSE2/AVX2 versions are picked at runtime where the CPU has them.
+
+// Whitespace, operators (; | ( ) ! & < >), quotes, backslash and $
+const char *scan_word_special(const char *p, const char *end);
+
+// Closing double quote, backslash and $
+const char *scan_dquote_special(const char *p, const char *end);
+
+// Use one implementation, "avx2", "sse2" or "scalar", instead of the
+// widest available; for benchmarks. Returns -1 if this CPU or build lacks it.
+int scan_select(const char *name);
+
+#endif
@@ -0,0 +1,252 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtins.h"
+#include "execute.h"
+#include "expand.h"
+#include "job_control.h"
+#include "job_table.h"
+#include "script.h"
+
+#define SCRIPT_READ_SIZE 65536
+
+extern int mu_last_status;
+
+/* Find the end of the first complete command in p[0..n).  A command ends
+   at a newline outside quotes and parentheses that doesn't follow |, &&,
+   || or a backslash.  Returns its length including the newline, or 0 if
+   more input is needed; at EOF whatever is left is one command.  Sets
+   *has_content when the command is more than blanks and comments.  */
+static size_t next_command(const char *p, size_t n, int at_eof,
+                           int *has_content) {
+  int squote = 0, dquote = 0, depth = 0, pending = 0, word_start = 1;
+  size_t i = 0;
+
+  *has_content = 0;
+
+  while (i < n) {
+    char c = p[i];
+
+    if (squote) {
+      if (c == '\'')
+        squote = 0;
+      i++;
+      continue;
+    }
+
+    if (c == '\\') {
+      if (i + 1 >= n)
+        break;
+      if (p[i + 1] != '\n') {
+        *has_content = 1;
+        pending = 0;
+        word_start = 0;
+      }
+      i += 2;
+      continue;
+    }
+
+    if (dquote) {
+      if (c == '"')
+        dquote = 0;
+      i++;
+      continue;
+    }
+
+    switch (c) {
+    case '\n':
+      if (depth == 0 && !pending)
+        return i + 1;
+      word_start = 1;
+      break;
+    case ' ':
+    case '\t':
+    case '\r':
+    case ';':
+    case '<':
+    case '>':
+      if (c == ';')
+        pending = 0;
+      word_start = 1;
+      break;
+    case '#':
+      if (word_start) {
+        while (i + 1 < n && p[i + 1] != '\n')
+          i++;
+      } else {
+        *has_content = 1;
+      }
+      break;
+    case '(':
+      depth++;
+      *has_content = 1;
+      word_start = 1;
+      break;
+    case ')':
+      if (depth > 0)
+        depth--;
+      pending = 0;
+      word_start = 1;
+      break;
+    case '|':
+      pending = 1;
+      word_start = 1;
+      break;
+    case '&':
+      // "&&" continues onto the next line, a lone '&' ends the command
+      if (i + 1 >= n && !at_eof)
+        return 0;
+      if (i + 1 < n && p[i + 1] == '&') {
+        pending = 1;
+        i++;
+      } else {
+        pending = 0;
+      }
+      word_start = 1;
+      break;
+    case '\'':
+      squote = 1;
+      *has_content = 1;
+      pending = 0;
+      word_start = 0;
+      break;
+    case '"':
+      dquote = 1;
+      *has_content = 1;
+      pending = 0;
+      word_start = 0;
+      break;
+    default:
+      *has_content = 1;
+      pending = 0;
+      word_start = 0;
+      break;
+    }
+    i++;
+  }
+
+  return at_eof ? n : 0;
+}
+
+/* Run every complete command in p[0..n).  Returns the number of bytes
+   consumed; anything after that is an incomplete command.  */
+static size_t run_commands(const char *p, size_t n, int at_eof, StrBuf *line) {
+  size_t done = 0;
+
+  while (done < n && !mu_exit_command) {
+    int has_content;
+    size_t len = next_command(p + done, n - done, at_eof, &has_content);
+    if (len == 0)
+      break;
+
+    if (has_content) {
+      // The parser wants a NUL-terminated line
+      strbuf_reset(line);
+      strbuf_append(line, p + done, len);
+      mu_last_status = mu_execute_logical_commands(line->data);
+      // Background jobs that have finished would otherwise pile up
+      if (job_table_max())
+        forget_completed_jobs();
+    }
+    done += len;
+  }
+
+  return done;
+}
+
+int mu_run_string(const char *text) {
+  StrBuf line;
+  strbuf_init(&line);
+  run_commands(text, strlen(text), 1, &line);
+  strbuf_free(&line);
+  return mu_last_status;
+}
+
+/* Pipes, terminals and other unmappable input: read in large blocks and
+   run each command as soon as its last line has arrived.  */
+int mu_run_fd(int fd) {
+  StrBuf buf, line;
+  strbuf_init(&buf);
+  strbuf_init(&line);
+
+  size_t start = 0;
+  int at_eof = 0;
+
+  while (!at_eof && !mu_exit_command) {
+    strbuf_reserve(&buf, SCRIPT_READ_SIZE);
+    ssize_t n = read(fd, buf.data + buf.len, SCRIPT_READ_SIZE);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("mu: read");
+      mu_last_status = 1;
+      break;
+    }
+    if (n == 0)
+      at_eof = 1;
+    buf.len += n;
+
+    start += run_commands(buf.data + start, buf.len - start, at_eof, &line);
+
+    // Keep only the unfinished command
+    if (start > 0) {
+      memmove(buf.data, buf.data + start, buf.len - start);
+      buf.len -= start;
+      start = 0;
+    }
+  }
+
+  strbuf_free(&buf);
+  strbuf_free(&line);
+  return mu_last_status;
+}
+
+/* Regular files are mapped and parsed in place; anything else is read
+   through mu_run_fd().  */
+int mu_run_script(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "mu: %s: %s\n", path, strerror(errno));
+    return 127;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    perror("mu: fstat");
+    close(fd);
+    return 1;
+  }
+
+  if (!S_ISREG(st.st_mode)) {
+    int status = mu_run_fd(fd);
+    close(fd);
+    return status;
+  }
+
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror("mu: mmap");
+    return 1;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  StrBuf line;
+  strbuf_init(&line);
+  run_commands(map, st.st_size, 1, &line);
+  strbuf_free(&line);
+
+  munmap(map, st.st_size);
+  return mu_last_status;
+}
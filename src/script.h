@@ -0,0 +1,12 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+// Non-interactive execution: script files, `mu -c` strings and piped stdin.
+// Input is split into complete commands and each one is parsed and run
+// before the next is read. All return the status of the last command.
+
+int mu_run_script(const char *path);
+int mu_run_fd(int fd);
+int mu_run_string(const char *text);
+
+#endif
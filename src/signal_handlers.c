@@ -1,7 +1,6 @@
 
 #include "builtins.h"
 #include "job_control.h"
-#include <sys/wait.h>
 #include <signal.h>
 
 #include <unistd.h>
@@ -9,20 +8,14 @@ extern int shell_is_interactive;
 extern int shell_terminal;
 extern int shell_pgid;
 
+// Set by the reaper when a job process changes state
 volatile sig_atomic_t job_notification_pending = 0;
-
-void sigchld_handler(int sig) {
-    (void)sig;
-    int status;
-    pid_t pid;
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
-        mark_process_status(pid, status);
-        job_notification_pending = 1;
-    }
-}
+// Set on Ctrl-C, so a builtin that blocks (wait) can give up
+volatile sig_atomic_t sigint_received = 0;
 
 void sigint_handler(int sig) {
     (void)sig;
+    sigint_received = 1;
     // Forward SIGINT to foreground job's process group (if any)
     if (shell_is_interactive) {
         // Send SIGINT to the foreground process group
@@ -46,7 +39,7 @@ void sigtstp_handler(int sig) {
 
 // Setup all signal handlers
 void setup_signal_handlers(void) {
-    struct sigaction sa_int, sa_tstp, sa_chld;
+    struct sigaction sa_int, sa_tstp;
 
     sa_int.sa_handler = sigint_handler;
     sigemptyset(&sa_int.sa_mask);
@@ -57,9 +50,4 @@ void setup_signal_handlers(void) {
     sigemptyset(&sa_tstp.sa_mask);
     sa_tstp.sa_flags = SA_RESTART;
     sigaction(SIGTSTP, &sa_tstp, NULL);
-
-    sa_chld.sa_handler = sigchld_handler;
-    sigemptyset(&sa_chld.sa_mask);
-    sa_chld.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    sigaction(SIGCHLD, &sa_chld, NULL);
 }
@@ -7,7 +7,7 @@
 #include <unistd.h>
 
 extern volatile sig_atomic_t job_notification_pending;
-void sigchld_handler(int sig);
+extern volatile sig_atomic_t sigint_received;
 void sigint_handler(int sig);
 void sigtstp_handler(int sig);
 void setup_signal_handlers(void);
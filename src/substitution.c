@@ -1,50 +1,65 @@
+#define _GNU_SOURCE /* pipe2, F_SETPIPE_SZ */
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "argv.h"
+#include "builtins.h"
 #include "execute.h"
+#include "expand.h"
+#include "launch.h"
+#include "reaper.h"
+#include "substitution.h"
 #include "tokenizer.h"
 
 extern int debug_substitution;
+extern int shell_is_interactive;
 
-char *execute_substitution(ASTNode *node) {
-  if (!node)
-    return strdup("");
-
-  if (debug_substitution) {
-    fprintf(stderr, "DEBUG: About to execute substitution\n");
-    if (node->type == NODE_COMMAND) {
-      fprintf(stderr, "DEBUG: Command has %d args\n", node->argc);
-      for (int i = 0; i < node->argc; i++) {
-        if (node->args[i].is_substitution) {
-          fprintf(stderr, "DEBUG: Arg %d is substitution\n", i);
-        } else {
-          fprintf(stderr, "DEBUG: Arg %d: '%s'\n", i, node->args[i].text);
-        }
+static void debug_node(ASTNode *node) {
+  fprintf(stderr, "DEBUG: About to execute substitution\n");
+  if (node->type == NODE_COMMAND) {
+    fprintf(stderr, "DEBUG: Command has %d args\n", node->argc);
+    for (int i = 0; i < node->argc; i++) {
+      if (node->args[i].is_substitution) {
+        fprintf(stderr, "DEBUG: Arg %d is substitution\n", i);
+      } else {
+        fprintf(stderr, "DEBUG: Arg %d: '%.*s'\n", i,
+                (int)node->args[i].word.len, node->args[i].word.text);
       }
     }
   }
+}
 
-  // Create a pipe for inter-process communication
+/* Fork a child running `node` with its stdout on a pipe.  Returns the
+   read end, or -1 if the child could not be started.  */
+static int start_substitution(ASTNode *node, pid_t *pid) {
+  if (debug_substitution)
+    debug_node(node);
+
+  // Close-on-exec so other substitutions started after this one don't
+  // keep the read end open
   int pipefd[2];
-  if (pipe(pipefd) == -1) {
+  if (pipe2(pipefd, O_CLOEXEC) == -1) {
     perror("pipe");
-    return strdup("");
+    return -1;
   }
 
-  pid_t pid = fork();
-  if (pid == 0) {
+  *pid = mu_fork();
+  if (*pid == 0) {
     // Child process
     close(pipefd[0]); // Close read end
+    shell_is_interactive = 0;
 
     // Redirect stdout to the write end of the pipe
     if (dup2(pipefd[1], STDOUT_FILENO) == -1) {
@@ -72,64 +87,213 @@ char *execute_substitution(ASTNode *node) {
       fprintf(stderr, "DEBUG: Child execute() returned status %d\n", status);
     }
     exit(status);
-  } else if (pid > 0) {
-    // Parent process
-    close(pipefd[1]); // Close write end
-
-    // Read all data from the pipe
-    char *output = malloc(4096);
-    if (!output) {
-      perror("malloc");
-      close(pipefd[0]);
-      waitpid(pid, NULL, 0);
-      return strdup("");
-    }
-
-    size_t total = 0;
-    size_t capacity = 4096;
-    ssize_t n;
-
-    while ((n = read(pipefd[0], output + total, capacity - total - 1)) > 0) {
-      total += n;
-      if (total >= capacity - 1) {
-        capacity *= 2;
-        char *new_output = realloc(output, capacity);
-        if (!new_output) {
-          perror("realloc");
-          free(output);
-          close(pipefd[0]);
-          waitpid(pid, NULL, 0);
-          return strdup("");
-        }
-        output = new_output;
-      }
-    }
+  }
 
-    output[total] = '\0';
+  close(pipefd[1]); // Close write end
+  if (*pid < 0) {
+    // Fork failed
+    perror("fork");
     close(pipefd[0]);
+    return -1;
+  }
+  return pipefd[0];
+}
 
-    int wstatus;
-    waitpid(pid, &wstatus, 0);
+// Once a substitution has filled a whole default-sized pipe its pipe is
+// enlarged, so a fast writer blocks less often and each read returns
+// more.  Reads are sized from FIONREAD so one call drains the pipe.
+#define SUBST_READ_MIN 65536
+#define SUBST_PIPE_SIZE (1024 * 1024)
 
-    if (debug_substitution) {
-      fprintf(stderr, "DEBUG: Child exit status: %d\n", WEXITSTATUS(wstatus));
-      fprintf(stderr, "DEBUG: Captured output: '%s' (length: %zu)\n", output,
-              total);
+static char *read_buf = NULL;
+static size_t read_cap = 0;
+
+/* Read what is waiting on fd and feed it to the splitter.  Returns 0 at
+   EOF, -1 on error and 1 if there may be more to come.  */
+static int read_chunk(int fd, FieldSplitter *out, int *grown) {
+  int avail = 0;
+  size_t want = SUBST_READ_MIN;
+  if (ioctl(fd, FIONREAD, &avail) == 0 && (size_t)avail > want)
+    want = avail;
+
+  if (want > read_cap) {
+    char *buf = realloc(read_buf, want);
+    if (!buf) {
+      perror("realloc");
+      exit(1);
     }
+    read_buf = buf;
+    read_cap = want;
+  }
+
+  ssize_t n = read(fd, read_buf, want);
+  if (n < 0)
+    return (errno == EINTR || errno == EAGAIN) ? 1 : -1;
+
+  if (!*grown && (size_t)n >= SUBST_READ_MIN) {
+    // Best effort: the limit is /proc/sys/fs/pipe-max-size
+    fcntl(fd, F_SETPIPE_SZ, SUBST_PIPE_SIZE);
+    *grown = 1;
+  }
+
+  splitter_feed(out, read_buf, n);
+  return n > 0;
+}
 
-    // Strip trailing newlines
-    while (total > 0 &&
-           (output[total - 1] == '\n' || output[total - 1] == '\r')) {
-      output[--total] = '\0';
+/* Reap the child and complete the last field of its output.  */
+static void finish_substitution(pid_t pid, FieldSplitter *out, int *status) {
+  int wstatus = 0;
+  reaper_wait_pid(pid, &wstatus);
+  if (WIFEXITED(wstatus))
+    *status = WEXITSTATUS(wstatus);
+  else if (WIFSIGNALED(wstatus))
+    *status = 128 + WTERMSIG(wstatus);
+
+  splitter_finish(out);
+
+  if (debug_substitution) {
+    fprintf(stderr, "DEBUG: Child exit status: %d\n", *status);
+    fprintf(stderr, "DEBUG: Captured %d fields (%zu bytes)\n", out->count,
+            out->bytes);
+  }
+}
+
+/* Run one substitution, splitting its output into `out` as it arrives.  */
+void execute_substitution(ASTNode *node, FieldSplitter *out, int *status) {
+  if (!node) {
+    splitter_finish(out);
+    return;
+  }
+
+  pid_t pid;
+  int fd = start_substitution(node, &pid);
+  if (fd < 0) {
+    splitter_finish(out);
+    *status = 1;
+    return;
+  }
+
+  int more, grown = 0;
+  while ((more = read_chunk(fd, out, &grown)) > 0)
+    ;
+  if (more < 0)
+    perror("read");
+  close(fd);
+
+  finish_substitution(pid, out, status);
+}
+
+/* True if running node can't change what another substitution sees:
+   an external command, or a pipeline of them, with no redirections and
+   no substitutions of its own that could.  A builtin (cd, read, exit),
+   a list or a subshell can, and so can a command whose name is only
+   known once a substitution has run.  */
+static int runs_independently(ASTNode *node) {
+  if (!node)
+    return 1;
+
+  switch (node->type) {
+  case NODE_SUBSTITUTE:
+    return runs_independently(node->left);
+  case NODE_PIPE:
+    return runs_independently(node->left) && runs_independently(node->right);
+  case NODE_COMMAND:
+    break;
+  default:
+    return 0;
+  }
+
+  if (node->redirs || node->argc == 0 || node->args[0].is_substitution)
+    return 0;
+  char *name = expand_word(&node->args[0].word);
+  int builtin = mu_find_builtin(name) >= 0;
+  free(name);
+  if (builtin)
+    return 0;
+
+  for (int i = 1; i < node->argc; i++)
+    if (node->args[i].is_substitution &&
+        !runs_independently(node->args[i].substitution_node))
+      return 0;
+  return 1;
+}
+
+/* Run the command substitutions of one command.  When every one of them
+   runs independently, all are started before any output is read and
+   their pipes drained together with poll(), so the command waits for the
+   slowest substitution rather than for the sum of them.  Otherwise, or
+   with `set -o serialsubst`, they run in order, each one finishing
+   before the next starts.  The output of nodes[i] is split into
+   outputs[i]; the return value is the exit status of the last one.  */
+int execute_substitutions(ASTNode **nodes, FieldSplitter *outputs, int n) {
+  int status = 0;
+
+  int serial = n == 1 || mu_opt_serialsubst;
+  for (int i = 0; !serial && i < n; i++)
+    serial = !runs_independently(nodes[i]);
+
+  if (serial) {
+    for (int i = 0; i < n; i++)
+      execute_substitution(nodes[i], &outputs[i], &status);
+    return status;
+  }
+
+  pid_t *pids = malloc(sizeof(pid_t) * n);
+  int *grown = calloc(n, sizeof(int));
+  struct pollfd *fds = malloc(sizeof(struct pollfd) * n);
+  if (!pids || !grown || !fds) {
+    perror("malloc");
+    exit(1);
+  }
+
+  int open_count = 0;
+  for (int i = 0; i < n; i++) {
+    pids[i] = -1;
+    fds[i].fd = nodes[i] ? start_substitution(nodes[i], &pids[i]) : -1;
+    fds[i].events = POLLIN;
+    fds[i].revents = 0;
+    if (fds[i].fd >= 0)
+      open_count++;
+  }
+
+  // poll() skips negative descriptors, so finished pipes are just
+  // switched off in place and the array keeps argument order
+  while (open_count > 0) {
+    if (poll(fds, n, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      break;
     }
 
-    return output;
+    for (int i = 0; i < n; i++) {
+      if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+      int more = read_chunk(fds[i].fd, &outputs[i], &grown[i]);
+      if (more <= 0) {
+        if (more < 0)
+          perror("read");
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        open_count--;
+      }
+    }
+  }
 
-  } else {
-    // Fork failed
-    perror("fork");
-    close(pipefd[0]);
-    close(pipefd[1]);
-    return strdup("");
+  for (int i = 0; i < n; i++) {
+    if (fds[i].fd >= 0)
+      close(fds[i].fd);
+    if (pids[i] < 0) {
+      splitter_finish(&outputs[i]);
+      if (nodes[i])
+        status = 1;
+    } else {
+      finish_substitution(pids[i], &outputs[i], &status);
+    }
   }
+
+  free(pids);
+  free(grown);
+  free(fds);
+  return status;
 }
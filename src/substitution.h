@@ -2,7 +2,9 @@
 #define SUBSTITUTION_H
 
 #import "tokenizer.h"
+#include "argv.h"
 
-char *execute_substitution(ASTNode *node);
+void execute_substitution(ASTNode *node, FieldSplitter *out, int *status);
+int execute_substitutions(ASTNode **nodes, FieldSplitter *outputs, int n);
 
 #endif
@@ -4,298 +4,244 @@
 #include <string.h>
 #include <unistd.h>
 
-char *process_quotes(const char *word);
-
-typedef enum {
-  TOKEN_WORD,
-  TOKEN_AND,
-  TOKEN_OR,
-  TOKEN_SEMI,
-  TOKEN_LPAREN,
-  TOKEN_RPAREN,
-  TOKEN_END,
-  TOKEN_PIPE,
-  TOKEN_WRITE,
-  TOKEN_APPEND,
-  TOKEN_READ,
-  TOKEN_ERR,
-  TOKEN_WRITE_ERR,
-  TOKEN_READWRITE,
-  TOKEN_SUBSTITUTE,
-  TOKEN_BANG,
-  TOKEN_JOB,
-} TokenType;
-
-typedef struct {
-  TokenType type;
-  char *text;
-} Token;
-
-struct ASTNode;
-
-#define MAX_TOKENS 1024
-
-Token tokens[MAX_TOKENS];
-int token_count = 0;
-int pos = 0;
-
-void add_token(TokenType type, const char *text) {
-  tokens[token_count++] = (Token){type, strdup(text)};
+#include "arena.h"
+#include "scan.h"
+#include "tokenizer.h"
+
+// Tokens are slices of the line being parsed. The array grows as needed and
+// is kept between lines, so tokenizing allocates nothing once it is warm.
+static Token *tokens = NULL;
+static size_t token_count = 0;
+static size_t token_capacity = 0;
+static size_t pos = 0;
+
+// Line being tokenized; token offsets are relative to it
+static const char *source = NULL;
+
+// Arena owning the AST of the line being parsed
+static Arena *arena = NULL;
+
+void add_token(TokenType type, const char *start, size_t len, int flags) {
+  if (token_count == token_capacity) {
+    size_t capacity = token_capacity ? token_capacity * 2 : 64;
+    Token *grown = realloc(tokens, capacity * sizeof(Token));
+    if (!grown) {
+      perror("realloc");
+      exit(1);
+    }
+    tokens = grown;
+    token_capacity = capacity;
+  }
+  tokens[token_count++] = (Token){type, flags, start - source, len};
 }
 
-char *expand_tilde(const char *word) {
-    if (word[0] != '~') {
-        return strdup(word);
-    }
-    
-    char *home = getenv("HOME");
-    if (!home) {
-        return strdup(word);  // If no HOME, return as-is
-    }
-    
-    if (word[1] == '\0' || word[1] == '/') {
-        // Handle ~ or ~/path
-        size_t home_len = strlen(home);
-        size_t word_len = strlen(word);
-        char *result = malloc(home_len + word_len);  // word_len includes the ~
-        strcpy(result, home);
-        if (word[1] == '/') {
-            strcat(result, word + 1);  // Skip the ~ but keep the /
-        }
-        return result;
-    }
-    
-    // TODO: implement user lookup with getpwnam()
-    // For now, just return the original word
-    return strdup(word);
+// Flags for a word whose extent was found without tracking quotes
+int word_flags(const char *start, size_t len) {
+  int flags = (len > 0 && start[0] == '~') ? WORD_TILDE : 0;
+  for (size_t i = 0; i < len; i++) {
+    if (start[i] == '\'' || start[i] == '"')
+      flags |= WORD_QUOTED;
+    else if (start[i] == '\\')
+      flags |= WORD_ESCAPED;
+    else if (start[i] == '$')
+      flags |= WORD_DOLLAR;
+  }
+  return flags;
+}
+
+void add_word(const char *start, size_t len) {
+  add_token(TOKEN_WORD, start, len, word_flags(start, len));
+}
+
+const char *token_text(const Token *tok) { return source + tok->offset; }
+
+// Scan an unquoted redirection target that directly follows its operator.
+// &N and &- (as in 2>&1) are targets too, not a background '&'.
+static const char *scan_redirect_target(const char *input) {
+  if (input[0] == '&' && (isdigit(input[1]) || input[1] == '-')) {
+    input += 2;
+    while (isdigit(*input))
+      input++;
+    return input;
+  }
+  while (*input && !isspace(*input) && *input != ';' && *input != '&' &&
+         *input != '|' && *input != '(' && *input != ')')
+    input++;
+  return input;
 }
 
-void tokenize(const char *input) {
+void tokenize(const char *input, Arena *line_arena) {
+  const char *end = input + strlen(input);
+
+  arena = line_arena;
+  source = input;
   token_count = 0;
   pos = 0;
 
   while (*input) {
+    if (*input == '\n') {
+      // A newline ends a command, unless the command can't end here yet
+      // (after |, &&, ( and the like)
+      if (token_count > 0 && (tokens[token_count - 1].type == TOKEN_WORD ||
+                              tokens[token_count - 1].type == TOKEN_RPAREN))
+        add_token(TOKEN_SEMI, input, 1, 0);
+      input++;
+      continue;
+    }
+
     if (isspace(*input)) {
       input++;
       continue;
     }
 
-    // Check for digit(s) followed by redirection operator without space
+    // Line continuation between words
+    if (input[0] == '\\' && input[1] == '\n') {
+      input += 2;
+      continue;
+    }
+
+    // Comment: skip to the end of the line
+    if (*input == '#') {
+      while (*input && *input != '\n')
+        input++;
+      continue;
+    }
+
+    // Digit(s) directly followed by a redirection operator name the fd
     if (isdigit(*input)) {
       const char *start = input;
       while (isdigit(*input))
         input++;
 
-      // Lookahead at redirection operator after digits
-      if (strncmp(input, ">>", 2) == 0 || strncmp(input, "<<", 2) == 0 ||
-          strncmp(input, "<>", 2) == 0) {
-        // tokenize fd number first
-        char *fdnum = strndup(start, input - start);
-        add_token(TOKEN_WORD, fdnum);
-        free(fdnum);
-
-        if (strncmp(input, ">>", 2) == 0) {
-          add_token(TOKEN_APPEND, ">>");
-          input += 2;
-        } else if (strncmp(input, "<>", 2) == 0) {
-          add_token(TOKEN_READWRITE, "<>");
-          input += 2;
-        }
-        continue;
-      } else if (*input == '>' || *input == '<') {
-        // tokenize fd number first
-        char *fdnum = strndup(start, input - start);
-        add_token(TOKEN_WORD, fdnum);
-        free(fdnum);
-
-        // Then tokenize 1-char redirection operator
-        if (*input == '>') {
-          add_token(TOKEN_WRITE, ">");
-        } else if (*input == '<') {
-          add_token(TOKEN_READ, "<");
-        }
-        input++;
-        continue;
-      } else {
-        // no redirection operator after digits, treat whole as word
-        char *word = strndup(start, input - start);
-        add_token(TOKEN_WORD, word);
-        free(word);
+      if (*input == '>' || *input == '<') {
+        // The fd number; the operator and its target follow as usual
+        add_token(TOKEN_WORD, start, input - start, 0);
         continue;
       }
+      // no redirection operator after digits, treat whole as word
+      input = start;
     }
 
     if (strncmp(input, "$(", 2) == 0) {
-      add_token(TOKEN_SUBSTITUTE, "$(");
+      add_token(TOKEN_SUBSTITUTE, input, 2, 0);
       input += 2;
     } else if (*input == '(') {
-      add_token(TOKEN_LPAREN, "(");
+      add_token(TOKEN_LPAREN, input, 1, 0);
       input++;
     } else if (*input == ')') {
-      add_token(TOKEN_RPAREN, ")");
+      add_token(TOKEN_RPAREN, input, 1, 0);
       input++;
     } else if (*input == '!') {
-      add_token(TOKEN_BANG, "!");
+      add_token(TOKEN_BANG, input, 1, 0);
       input++;
     } else if (*input == ';') {
-      add_token(TOKEN_SEMI, ";");
+      add_token(TOKEN_SEMI, input, 1, 0);
       input++;
     } else if (strncmp(input, "&&", 2) == 0) {
-      add_token(TOKEN_AND, "&&");
+      add_token(TOKEN_AND, input, 2, 0);
       input += 2;
     } else if (*input == '&') {
-      add_token(TOKEN_JOB, "&");
+      add_token(TOKEN_JOB, input, 1, 0);
       input++;
     } else if (strncmp(input, "||", 2) == 0) {
-      add_token(TOKEN_OR, "||");
-      input += 2;
-    } else if (strncmp(input, ">>", 2) == 0) {
+      add_token(TOKEN_OR, input, 2, 0);
       input += 2;
+    } else if (*input == '>' || *input == '<') {
+      TokenType type;
+      size_t op_len = 2;
+      if (input[0] == '>' && input[1] == '>')
+        type = TOKEN_APPEND;
+      else if (input[0] == '<' && input[1] == '>')
+        type = TOKEN_READWRITE;
+      else {
+        type = (*input == '>') ? TOKEN_WRITE : TOKEN_READ;
+        op_len = 1;
+      }
+      add_token(type, input, op_len, 0);
+      input += op_len;
+
       // Check if there's an immediate filename
       const char *start = input;
-      while (*input && !isspace(*input) && *input != ';' && *input != '&' &&
-             *input != '|' && *input != '(' && *input != ')')
-        input++;
-      char *word = strndup(start, input - start);
-      add_token(TOKEN_APPEND, ">>");
-      if (strlen(word) > 0)
-        add_token(TOKEN_WORD, word);
-      free(word);
-    } else if (strncmp(input, "2>", 2) == 0) {
-      input += 2;
-      const char *start = input;
-      while (*input && !isspace(*input) && *input != ';' && *input != '&' &&
-             *input != '|' && *input != '(' && *input != ')')
-        input++;
-      char *word = strndup(start, input - start);
-      add_token(TOKEN_ERR, "2>");
-      if (strlen(word) > 0)
-        add_token(TOKEN_WORD, word);
-      free(word);
-    } else if (strncmp(input, "<>", 2) == 0) {
-      input += 2;
-      const char *start = input;
-      while (*input && !isspace(*input) && *input != ';' && *input != '&' &&
-             *input != '|' && *input != '(' && *input != ')')
-        input++;
-      char *word = strndup(start, input - start);
-      add_token(TOKEN_READWRITE, "<>");
-      if (strlen(word) > 0)
-        add_token(TOKEN_WORD, word);
-      free(word);
-    } else if (*input == '>') {
-      input++;
-      const char *start = input;
-      while (*input && !isspace(*input) && *input != ';' && *input != '&' &&
-             *input != '|' && *input != '(' && *input != ')')
-        input++;
-      char *word = strndup(start, input - start);
-      add_token(TOKEN_WRITE, ">");
-      if (strlen(word) > 0)
-        add_token(TOKEN_WORD, word);
-      free(word);
-    } else if (*input == '<') {
-      input++;
-      const char *start = input;
-      while (*input && !isspace(*input) && *input != ';' && *input != '&' &&
-             *input != '|' && *input != '(' && *input != ')')
-        input++;
-      char *word = strndup(start, input - start);
-      add_token(TOKEN_READ, "<");
-      if (strlen(word) > 0)
-        add_token(TOKEN_WORD, word);
-      free(word);
+      input = scan_redirect_target(input);
+      if (input > start)
+        add_word(start, input - start);
     } else if (*input == '|') {
-      add_token(TOKEN_PIPE, "|");
+      add_token(TOKEN_PIPE, input, 1, 0);
       input++;
     } else {
       const char *start = input;
-      int in_single_quote = 0;
-      int in_double_quote = 0;
-
-      while (*input && (in_single_quote || in_double_quote ||
-                        (!isspace(*input) && *input != ';' && *input != '|' &&
-                         *input != '(' && *input != ')' && *input != '!' &&
-                         *input != '&' && *input != '<' && *input != '>'))) {
-
-        if (*input == '\'' && !in_double_quote) {
-          in_single_quote = !in_single_quote;
-        } else if (*input == '"' && !in_single_quote) {
-          in_double_quote = !in_double_quote;
-        } else if (*input == '\\' && !in_single_quote) {
-          // Skip escaped character
+      int flags = (*input == '~') ? WORD_TILDE : 0;
+      int unterminated = 0;
+
+      // Jump between the bytes that matter instead of testing every byte
+      for (;;) {
+        input = scan_word_special(input, end);
+        if (input == end)
+          break;
+
+        if (*input == '$') {
+          flags |= WORD_DOLLAR;
           input++;
-          if (*input)
+          // $! and ${!} are a parameter, not the ! operator
+          if (input < end && *input == '!')
             input++;
-          continue;
+          else if (end - input >= 2 && input[0] == '{' && input[1] == '!')
+            input += 2;
+        } else if (*input == '\\') {
+          // Skip escaped character
+          flags |= WORD_ESCAPED;
+          input += (input + 1 < end) ? 2 : 1;
+        } else if (*input == '\'') {
+          flags |= WORD_QUOTED;
+          const char *close = memchr(input + 1, '\'', end - (input + 1));
+          if (!close) {
+            unterminated = 1;
+            break;
+          }
+          input = close + 1;
+        } else if (*input == '"') {
+          flags |= WORD_QUOTED;
+          input++;
+          for (;;) {
+            input = scan_dquote_special(input, end);
+            if (input == end) {
+              unterminated = 1;
+              break;
+            }
+            if (*input == '"')
+              break;
+            if (*input == '$')
+              flags |= WORD_DOLLAR;
+            else
+              flags |= WORD_ESCAPED;
+            input += (*input == '\\' && input + 1 < end) ? 2 : 1;
+          }
+          if (unterminated)
+            break;
+          input++;
+        } else {
+          // Whitespace or an operator ends the word
+          break;
         }
-        input++;
       }
 
-      if (in_single_quote || in_double_quote) {
+      if (unterminated) {
         fprintf(stderr, "mu: unterminated quoted string\n");
+        // Leave only an end marker so the parser can't see stale tokens
+        token_count = 0;
+        add_token(TOKEN_END, end, 0, 0);
         return;
       }
 
-     if (start != input) {
-          char *raw_word = strndup(start, input - start);
-          char *processed_word = process_quotes(raw_word);
-          char *expanded_word = expand_tilde(processed_word);
-          add_token(TOKEN_WORD, expanded_word);
-          free(raw_word);
-          free(processed_word);
-          free(expanded_word);
-      }
+      // Quote removal and expansion are left to execution time
+      if (start != input)
+        add_token(TOKEN_WORD, start, input - start, flags);
     }
   }
 
-  add_token(TOKEN_END, "<end>");
+  add_token(TOKEN_END, input, 0, 0);
 }
 
-typedef enum {
-  NODE_COMMAND,
-  NODE_AND,
-  NODE_OR,
-  NODE_SEQUENCE,
-  NODE_SUBSHELL,
-  NODE_PIPE,
-  NODE_WRITE,
-  NODE_APPEND,
-  NODE_READ,
-  NODE_ERR,
-  NODE_WRITE_ERR,
-  NODE_READWRITE,
-  NODE_SUBSTITUTE,
-  NODE_BANG,
-  NODE_JOB,
-} NodeType;
-
-typedef struct Redirection {
-  int fd;
-  NodeType type;
-  char *filename;
-  int close_fd;
-  struct Redirection *next;
-} Redirection;
-
-typedef struct Arg {
-  int is_substitution;
-  union {
-    char *text;
-    struct ASTNode *substitution_node;
-  };
-} Arg;
-
-typedef struct ASTNode {
-  NodeType type;
-  struct ASTNode *left;
-  struct ASTNode *right;
-  struct Arg *args;
-  int argc;
-
-  Redirection *redirs;
-} ASTNode;
-
 ASTNode *parse_sequence();
 
 Token *peek() { return &tokens[pos]; }
@@ -310,13 +256,17 @@ int match(TokenType type) {
   return 0;
 }
 
-int is_all_digits(const char *s) {
-  for (; *s; s++)
-    if (!isdigit(*s))
+int is_all_digits(const char *s, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    if (!isdigit(s[i]))
       return 0;
   return 1;
 }
 
+Word token_word(const Token *tok) {
+  return (Word){token_text(tok), tok->length, tok->flags};
+}
+
 NodeType node_type_for_token_type(TokenType t) {
   switch (t) {
   case TOKEN_READ:
@@ -336,13 +286,19 @@ NodeType node_type_for_token_type(TokenType t) {
   }
 }
 
+// Allocate a zeroed AST node of the given type from the line arena
+ASTNode *new_node(NodeType type) {
+  ASTNode *node = arena_calloc(arena, 1, sizeof(ASTNode));
+  node->type = type;
+  return node;
+}
+
 // Helper to create a new Redirection node and append it to the list
-void add_redirection(ASTNode *node, int fd, NodeType type,
-                     const char *filename) {
-  Redirection *new_redir = malloc(sizeof(Redirection));
+void add_redirection(ASTNode *node, int fd, NodeType type, Word target) {
+  Redirection *new_redir = arena_calloc(arena, 1, sizeof(Redirection));
   new_redir->fd = fd;
   new_redir->type = type;
-  new_redir->filename = strdup(filename);
+  new_redir->target = target;
   new_redir->next = NULL;
 
   if (!node->redirs) {
@@ -368,23 +324,15 @@ ASTNode *parse_substitute() {
     return NULL;
   }
 
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_SUBSTITUTE;
+  ASTNode *node = new_node(NODE_SUBSTITUTE);
   node->left = inner;
-  node->right = NULL;
-  node->args = NULL;
-  node->redirs = NULL;
   return node;
 }
 
 ASTNode *parse_command() {
   if (match(TOKEN_LPAREN)) {
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = NODE_SUBSHELL;
+    ASTNode *node = new_node(NODE_SUBSHELL);
     node->left = parse_sequence();
-    node->right = NULL;
-    node->args = NULL;
-    node->redirs = NULL;
 
     if (!match(TOKEN_RPAREN)) {
       fprintf(stderr, "Expected ')'\n");
@@ -398,12 +346,10 @@ ASTNode *parse_command() {
     return NULL; // Not a command start token
   }
 
-  ASTNode *node = calloc(1, sizeof(ASTNode));
-  node->type = NODE_COMMAND;
-  node->left = node->right = NULL;
-  node->redirs = NULL;
+  ASTNode *node = new_node(NODE_COMMAND);
 
-  struct Arg *args = malloc(sizeof(Arg) * 64);
+  int args_capacity = 16;
+  struct Arg *args = arena_alloc(arena, sizeof(Arg) * args_capacity);
   int argc = 0;
 
   while (peek()->type == TOKEN_WORD || peek()->type == TOKEN_WRITE ||
@@ -413,15 +359,18 @@ ASTNode *parse_command() {
 
     int fd = -1;
 
-    // Handle explicit FD prefix (like 2>)
-    if (peek()->type == TOKEN_WORD && is_all_digits(peek()->text)) {
+    // Handle explicit FD prefix (like 2>); "2 >" is an argument and a
+    // redirection of stdout
+    if (peek()->type == TOKEN_WORD &&
+        is_all_digits(token_text(peek()), peek()->length)) {
       Token *fd_token = peek();
       Token *next = &tokens[pos + 1];
 
-      if (next->type == TOKEN_WRITE || next->type == TOKEN_APPEND ||
-          next->type == TOKEN_READ || next->type == TOKEN_ERR ||
-          next->type == TOKEN_WRITE_ERR || next->type == TOKEN_READWRITE) {
-        fd = atoi(fd_token->text);
+      if (fd_token->offset + fd_token->length == next->offset &&
+          (next->type == TOKEN_WRITE || next->type == TOKEN_APPEND ||
+           next->type == TOKEN_READ || next->type == TOKEN_ERR ||
+           next->type == TOKEN_WRITE_ERR || next->type == TOKEN_READWRITE)) {
+        fd = (int)strtol(token_text(fd_token), NULL, 10);
         consume(); // consume the fd token
       }
     }
@@ -459,56 +408,29 @@ ASTNode *parse_command() {
         }
       }
 
+      // The target is expanded when the redirection is applied
       Token *file_tok = consume();
-
-      char *expanded_filename = expand_tilde(file_tok->text);
-
-      Redirection *r = malloc(sizeof(Redirection));
-      r->fd = fd;
-      r->filename = expanded_filename;
-      r->next = NULL;
-
-      switch (redir_tok) {
-      case TOKEN_WRITE:
-        r->type = NODE_WRITE;
-        break;
-      case TOKEN_APPEND:
-        r->type = NODE_APPEND;
-        break;
-      case TOKEN_READ:
-        r->type = NODE_READ;
-        break;
-      case TOKEN_ERR:
-        r->type = NODE_ERR;
-        break;
-      case TOKEN_WRITE_ERR:
-        r->type = NODE_WRITE_ERR;
-        break;
-      case TOKEN_READWRITE:
-        r->type = NODE_READWRITE;
-        break;
-      default:
-        r->type = NODE_WRITE;
-        break;
+      add_redirection(node, fd, node_type_for_token_type(redir_tok),
+                      token_word(file_tok));
+    } else {
+      if (argc == args_capacity) {
+        // Arena memory can't be resized; copy into a block twice the size
+        struct Arg *grown = arena_alloc(arena, sizeof(Arg) * args_capacity * 2);
+        memcpy(grown, args, sizeof(Arg) * argc);
+        args = grown;
+        args_capacity *= 2;
       }
 
-      // Append redirection to node->redirs
-      if (!node->redirs) {
-        node->redirs = r;
-      } else {
-        Redirection *tail = node->redirs;
-        while (tail->next)
-          tail = tail->next;
-        tail->next = r;
+      if (tok->type == TOKEN_SUBSTITUTE) {
+        args[argc].is_substitution = 1;
+        args[argc].substitution_node = parse_substitute();
+        argc++;
+      } else if (tok->type == TOKEN_WORD) {
+        // Keep the raw slice; quote removal and expansion happen at exec
+        args[argc].is_substitution = 0;
+        args[argc].word = token_word(consume());
+        argc++;
       }
-    } else if (tok->type == TOKEN_SUBSTITUTE) {
-      args[argc].is_substitution = 1;
-      args[argc].substitution_node = parse_substitute();
-      argc++;
-    } else if (tok->type == TOKEN_WORD) {
-      args[argc].is_substitution = 0;
-      args[argc].text = strdup(consume()->text);
-      argc++;
     }
   }
 
@@ -529,13 +451,9 @@ ASTNode *parse_pipeline() {
       return NULL;
     }
 
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = NODE_PIPE;
+    ASTNode *node = new_node(NODE_PIPE);
     node->left = left;
     node->right = right;
-    node->args = NULL;
-    node->redirs = NULL;
-    node->argc = 0;
     left = node;
   }
 
@@ -549,10 +467,8 @@ ASTNode *parse_prefix() {
       fprintf(stderr, "mu: syntax error: expected command after '!'\n");
       return NULL;
     }
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = NODE_BANG;
+    ASTNode *node = new_node(NODE_BANG);
     node->left = child;
-    node->right = NULL;
     return node;
   }
 
@@ -564,297 +480,58 @@ ASTNode *parse_prefix() {
 }
 
 ASTNode *parse_and_or() {
-  ASTNode *left;
-
-  if (match(TOKEN_LPAREN)) {
-    ASTNode *subshell = malloc(sizeof(ASTNode));
-    subshell->type = NODE_SUBSHELL;
-    subshell->left = parse_sequence();
-    subshell->right = NULL;
-    subshell->args = NULL;
-    subshell->redirs = NULL;
-    subshell->argc = 0;
-
-    if (!match(TOKEN_RPAREN)) {
-      fprintf(stderr, "Expected ')'\n");
-      return NULL;
-    }
-    left = subshell;
-  } else {
-    left = parse_prefix();
-  }
+  // Subshells are parsed by parse_command(), so they can be piped
+  ASTNode *left = parse_prefix();
 
   while (peek()->type == TOKEN_AND || peek()->type == TOKEN_OR) {
     TokenType op = consume()->type;
 
-    ASTNode *right;
-
-    if (match(TOKEN_LPAREN)) {
-      ASTNode *subshell = malloc(sizeof(ASTNode));
-      subshell->type = NODE_SUBSHELL;
-      subshell->left = parse_sequence();
-      subshell->right = NULL;
-      subshell->args = NULL;
-      subshell->redirs = NULL;
-      subshell->argc = 0;
+    ASTNode *right = parse_prefix();
 
-      if (!match(TOKEN_RPAREN)) {
-        fprintf(stderr, "Expected ')'\n");
-        return NULL;
-      }
-      right = subshell;
-    } else {
-      right = parse_prefix();
-    }
-
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = (op == TOKEN_AND) ? NODE_AND : NODE_OR;
+    ASTNode *node = new_node((op == TOKEN_AND) ? NODE_AND : NODE_OR);
     node->left = left;
     node->right = right;
-    node->args = NULL;
-    node->redirs = NULL;
-    node->argc = 0;
     left = node;
   }
 
   // Check for background job indicator
   if (match(TOKEN_JOB)) {
-    ASTNode *job_node = malloc(sizeof(ASTNode));
-    job_node->type = NODE_JOB;
+    ASTNode *job_node = new_node(NODE_JOB);
     job_node->left = left;
-    job_node->right = NULL;
-    job_node->args = NULL;
-    job_node->redirs = NULL;
-    job_node->argc = 0;
     left = job_node;
   }
 
   return left;
 }
 
+// True if the next token can begin a command
+int peek_starts_command() {
+  TokenType t = peek()->type;
+  return t == TOKEN_WORD || t == TOKEN_SUBSTITUTE || t == TOKEN_LPAREN ||
+         t == TOKEN_BANG;
+}
+
 ASTNode *parse_sequence() {
   ASTNode *left = parse_and_or();
+  ASTNode *last = left;
 
-  while (match(TOKEN_SEMI)) {
+  // Commands are separated by ';', or follow a '&' that ended the last one
+  while (match(TOKEN_SEMI) ||
+         (last && last->type == NODE_JOB && peek_starts_command())) {
     ASTNode *right = parse_and_or();
     if (!right)
       break;
+    last = right;
 
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = NODE_SEQUENCE;
+    ASTNode *node = new_node(NODE_SEQUENCE);
     node->left = left;
     node->right = right;
-    node->args = NULL;
-    node->redirs = NULL;
-    node->argc = 0;
     left = node;
   }
 
   return left;
 }
 
-char *expand_variables(const char *input) {
-    if (!input) return NULL;
-    
-    size_t len = strlen(input);
-    size_t capacity = len * 2; // Start with double the input size
-    char *result = malloc(capacity);
-    if (!result) return NULL;
-    
-    size_t out_pos = 0;
-    size_t i = 0;
-    
-    while (i < len) {
-        if (input[i] == '$' && i + 1 < len) {
-            i++; // Skip the $
-            
-            char *var_name = NULL;
-            char *var_value = NULL;
-            
-            if (input[i] == '{') {
-                // ${VAR} format
-                i++; // Skip the {
-                size_t start = i;
-                while (i < len && input[i] != '}') {
-                    i++;
-                }
-                if (i < len && input[i] == '}') {
-                    var_name = strndup(input + start, i - start);
-                    i++; // Skip the }
-                }
-            } else if (input[i] == '$') {
-                // $$ - process ID
-                var_value = malloc(20);
-                snprintf(var_value, 20, "%d", getpid());
-                i++;
-            } else if (input[i] == '?') {
-                // $? - last exit status
-                extern int mu_last_status;
-                var_value = malloc(20);
-                snprintf(var_value, 20, "%d", mu_last_status);
-                i++;
-            } else if (isalnum(input[i]) || input[i] == '_') {
-                // $VAR format - alphanumeric and underscore only
-                size_t start = i;
-                while (i < len && (isalnum(input[i]) || input[i] == '_')) {
-                    i++;
-                }
-                var_name = strndup(input + start, i - start);
-            } else {
-                // Just a $ followed by something else - treat as literal
-                result[out_pos++] = '$';
-                continue;
-            }
-            
-            // Get variable value if we have a name
-            if (var_name && !var_value) {
-                char *env_value = getenv(var_name);
-                if (env_value) {
-                    var_value = strdup(env_value);
-                }
-                free(var_name);
-            }
-            
-            // Append the value or empty string if not found
-            if (var_value) {
-                size_t val_len = strlen(var_value);
-                
-                // Ensure we have enough space
-                while (out_pos + val_len >= capacity) {
-                    capacity *= 2;
-                    char *new_result = realloc(result, capacity);
-                    if (!new_result) {
-                        free(result);
-                        free(var_value);
-                        return NULL;
-                    }
-                    result = new_result;
-                }
-                
-                strcpy(result + out_pos, var_value);
-                out_pos += val_len;
-                free(var_value);
-            }
-            // If variable not found, expand to empty string (standard shell behavior)
-            
-        } else {
-            // Ensure we have space for one more character
-            if (out_pos + 1 >= capacity) {
-                capacity *= 2;
-                char *new_result = realloc(result, capacity);
-                if (!new_result) {
-                    free(result);
-                    return NULL;
-                }
-                result = new_result;
-            }
-            
-            result[out_pos++] = input[i++];
-        }
-    }
-    
-    result[out_pos] = '\0';
-    return result;
-}
-
-// Corrected process_quotes function that properly handles single quotes
-char *process_quotes(const char *word) {
-    if (!word) return NULL;
-    
-    size_t len = strlen(word);
-    char *result = malloc(len * 4 + 1);
-    if (!result) return NULL;
-    
-    size_t out_pos = 0;
-    size_t i = 0;
-    
-    // Check if entire word is wrapped in single quotes
-    int entirely_single_quoted = (len >= 2 && word[0] == '\'' && word[len-1] == '\'');
-    
-    if (entirely_single_quoted) {
-        // Copy everything between the single quotes literally - no expansion
-        for (i = 1; i < len - 1; i++) {
-            result[out_pos++] = word[i];
-        }
-        result[out_pos] = '\0';
-        return result;
-    }
-    
-    // Process mixed or unquoted content
-    while (i < len) {
-        if (word[i] == '\'') {
-            // Single quotes within the word - everything literal until closing quote
-            i++; // skip opening quote
-            while (i < len && word[i] != '\'') {
-                result[out_pos++] = word[i++];
-            }
-            if (i < len) i++; // skip closing quote
-            
-        } else if (word[i] == '"') {
-            // Double quotes: process content but allow variable expansion
-            i++; // skip opening quote
-            char *temp = malloc(len * 2);
-            size_t temp_pos = 0;
-            
-            while (i < len && word[i] != '"') {
-                if (word[i] == '\\' && i + 1 < len) {
-                    char next = word[i + 1];
-                    if (next == '"' || next == '\\' || next == '$' || next == '`' || next == '\n') {
-                        temp[temp_pos++] = next;
-                        i += 2;
-                    } else {
-                        temp[temp_pos++] = word[i++];
-                    }
-                } else {
-                    temp[temp_pos++] = word[i++];
-                }
-            }
-            temp[temp_pos] = '\0';
-            
-            // Expand variables in double-quoted content
-            char *expanded = expand_variables(temp);
-            if (expanded) {
-                size_t exp_len = strlen(expanded);
-                // Ensure we have enough space
-                while (out_pos + exp_len >= len * 4) {
-                    len *= 2;
-                    char *new_result = realloc(result, len * 4 + 1);
-                    if (!new_result) {
-                        free(result);
-                        free(expanded);
-                        free(temp);
-                        return NULL;
-                    }
-                    result = new_result;
-                }
-                strcpy(result + out_pos, expanded);
-                out_pos += exp_len;
-                free(expanded);
-            }
-            free(temp);
-            
-            if (i < len) i++; // skip closing quote
-            
-        } else if (word[i] == '\\' && i + 1 < len) {
-            // Unquoted backslash escape
-            result[out_pos++] = word[i + 1];
-            i += 2;
-            
-        } else {
-            // Unquoted content - copy as-is for now
-            result[out_pos++] = word[i++];
-        }
-    }
-    
-    result[out_pos] = '\0';
-    
-    // Expand variables in the unquoted/double-quoted content
-    char *final_result = expand_variables(result);
-    free(result);
-    
-    return final_result ? final_result : strdup("");
-}
-
 void print_ast(ASTNode *node, int depth) {
   for (int i = 0; i < depth; i++)
     printf("  ");
@@ -870,7 +547,7 @@ void print_ast(ASTNode *node, int depth) {
       if (node->args[i].is_substitution)
         printf(" $(...)");
       else
-        printf(" %s", node->args[i].text);
+        printf(" %.*s", (int)node->args[i].word.len, node->args[i].word.text);
     }
     printf("\n");
     break;
@@ -1,6 +1,8 @@
 #ifndef SHELL_PARSER_H
 #define SHELL_PARSER_H
 
+#include "arena.h"
+
 typedef enum {
   TOKEN_WORD,
   TOKEN_AND,
@@ -18,14 +20,25 @@ typedef enum {
   TOKEN_READWRITE,
   TOKEN_SUBSTITUTE,
   TOKEN_BANG,
+  TOKEN_JOB,
 } TokenType;
 
+// Word flags: which kinds of processing a word still needs at execution
+#define WORD_QUOTED 0x1  /* contains ' or " */
+#define WORD_ESCAPED 0x2 /* contains a backslash */
+#define WORD_DOLLAR 0x4  /* contains $ */
+#define WORD_TILDE 0x8   /* starts with ~ */
+
+// A token is a slice of the input line; nothing is copied while tokenizing
 typedef struct {
   TokenType type;
-  char *text;
+  int flags;
+  size_t offset;
+  size_t length;
 } Token;
 
-void tokenize(const char *input);
+void tokenize(const char *input, Arena *line_arena);
+const char *token_text(const Token *tok);
 Token *peek();
 Token *consume();
 int match(TokenType type);
@@ -50,24 +63,36 @@ typedef enum {
   NODE_JOB,        // Fixed typo: was NODE_SUBSTITUE
 } NodeType;
 
+// A word as written in the input line, still quoted and unexpanded. The
+// text is not NUL-terminated and stays valid as long as the line does.
+typedef struct Word {
+  const char *text;
+  size_t len;
+  int flags;
+} Word;
+
 typedef struct Redirection {
   int fd;
   NodeType type;
-  char *filename; // remains valid if not a close
-  int close_fd;   // NEW: 1 if this is a close (e.g., 2>&-)
+  Word target;  // file name, or &N / &- for dups and closes
+  int close_fd; // NEW: 1 if this is a close (e.g., 2>&-)
   struct Redirection *next;
 } Redirection;
 
 typedef struct Arg {
   int is_substitution;
   union {
-    char *text;
+    Word word;
     struct ASTNode *substitution_node;
   };
 } Arg;
 
+// Node flags, set by mark_exec_tails() after parsing
+#define NODE_EXEC_TAIL 0x1 /* last thing a forked child runs: exec in place */
+
 typedef struct ASTNode {
   NodeType type;
+  int flags;
   struct ASTNode *left;
   struct ASTNode *right;
   struct Arg *args;
@@ -76,7 +101,6 @@ typedef struct ASTNode {
   Redirection *redirs;
 } ASTNode;
 
-char *process_quotes(const char *word);
 ASTNode *parse_sequence();
 void print_ast(ASTNode *node, int depth);
 
@@ -0,0 +1,430 @@
+/* Bytes the line editor writes per key, driven over a pseudo-terminal.
+
+   A key typed or deleted in the middle of a line must cost a small
+   constant number of bytes, however much text follows the cursor: the
+   render layer sends only the difference, and the terminal shifts the
+   tail itself.  On a terminal too narrow for the line, what the editor
+   writes is played on a model screen and must show the line as edited.
+   Usage: render_pty path/to/mu  */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <ftw.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Largest write expected for one mid-line key: a cursor move, an
+// insert or delete sequence and the character itself
+#define MAX_KEY_BYTES 16
+
+// The narrow terminal, and the part of the screen the line is drawn on
+#define NARROW_COLS 80
+#define NARROW_ROWS 40
+
+static int master = -1;
+static int failures = 0;
+
+/* A screen that follows what a VT100-style terminal would do with the
+   editor's output: printing with autowrap, CR, LF, and the CSI cursor
+   moves, insert, delete and erase sequences it uses.  Colours and modes
+   are ignored.  */
+static struct {
+  int on;
+  char cells[NARROW_ROWS][NARROW_COLS];
+  int row, col;
+  int pending_wrap; /* last column written; the next character wraps */
+  int esc;          /* 0, 1 after ESC, 2 inside a CSI sequence */
+  char params[32];
+  int nparams;
+} screen;
+
+static void screen_clear(int row, int col, int rows) {
+  for (int r = row; r < row + rows && r < NARROW_ROWS; r++) {
+    int from = r == row ? col : 0;
+    memset(screen.cells[r] + from, ' ', NARROW_COLS - from);
+  }
+}
+
+static void screen_newline(void) {
+  if (screen.row < NARROW_ROWS - 1) {
+    screen.row++;
+    return;
+  }
+  memmove(screen.cells[0], screen.cells[1],
+          sizeof(screen.cells[0]) * (NARROW_ROWS - 1));
+  screen_clear(NARROW_ROWS - 1, 0, 1);
+}
+
+static int clamp(int v, int lo, int hi) {
+  return v < lo ? lo : v > hi ? hi : v;
+}
+
+static void screen_csi(char final) {
+  screen.params[screen.nparams] = '\0';
+  int a = 0, b = 0;
+  const char *p = screen.params[0] == '?' ? screen.params + 1 : screen.params;
+  sscanf(p, "%d;%d", &a, &b);
+  int n = a ? a : 1;
+  char *row = screen.cells[screen.row];
+
+  screen.pending_wrap = 0;
+  switch (final) {
+  case 'A':
+    screen.row = clamp(screen.row - n, 0, NARROW_ROWS - 1);
+    break;
+  case 'B':
+    screen.row = clamp(screen.row + n, 0, NARROW_ROWS - 1);
+    break;
+  case 'C':
+    screen.col = clamp(screen.col + n, 0, NARROW_COLS - 1);
+    break;
+  case 'D':
+    screen.col = clamp(screen.col - n, 0, NARROW_COLS - 1);
+    break;
+  case 'H':
+    screen.row = clamp(n - 1, 0, NARROW_ROWS - 1);
+    screen.col = clamp((b ? b : 1) - 1, 0, NARROW_COLS - 1);
+    break;
+  case 'J':
+    if (a == 2)
+      screen_clear(0, 0, NARROW_ROWS);
+    else
+      screen_clear(screen.row, screen.col, NARROW_ROWS);
+    break;
+  case 'K':
+    screen_clear(screen.row, screen.col, 1);
+    break;
+  case '@':
+    n = clamp(n, 0, NARROW_COLS - screen.col);
+    memmove(row + screen.col + n, row + screen.col,
+            NARROW_COLS - screen.col - n);
+    memset(row + screen.col, ' ', n);
+    break;
+  case 'P':
+    n = clamp(n, 0, NARROW_COLS - screen.col);
+    memmove(row + screen.col, row + screen.col + n,
+            NARROW_COLS - screen.col - n);
+    memset(row + NARROW_COLS - n, ' ', n);
+    break;
+  }
+}
+
+static void screen_feed(const char *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    unsigned char ch = buf[i];
+    if (screen.esc == 1) {
+      screen.esc = ch == '[' ? 2 : 0;
+      screen.nparams = 0;
+    } else if (screen.esc == 2) {
+      if (ch >= '@' && ch <= '~') {
+        screen_csi(ch);
+        screen.esc = 0;
+      } else if (screen.nparams < (int)sizeof(screen.params) - 1) {
+        screen.params[screen.nparams++] = ch;
+      }
+    } else if (ch == '\033') {
+      screen.esc = 1;
+    } else if (ch == '\r') {
+      screen.col = 0;
+      screen.pending_wrap = 0;
+    } else if (ch == '\n') {
+      screen_newline();
+      screen.pending_wrap = 0;
+    } else if (ch == '\b') {
+      screen.col = clamp(screen.col - 1, 0, NARROW_COLS - 1);
+      screen.pending_wrap = 0;
+    } else if (ch >= ' ' && (ch & 0xC0) != 0x80) {
+      // One cell per character; UTF-8 continuation bytes take none
+      if (screen.pending_wrap) {
+        screen.col = 0;
+        screen_newline();
+        screen.pending_wrap = 0;
+      }
+      screen.cells[screen.row][screen.col] = ch < 0x80 ? ch : '?';
+      if (screen.col == NARROW_COLS - 1)
+        screen.pending_wrap = 1;
+      else
+        screen.col++;
+    }
+  }
+}
+
+/* Read whatever the shell writes until it has been quiet for quiet_ms.
+   Returns the number of bytes read.  */
+static size_t drain(int quiet_ms) {
+  char buf[65536];
+  size_t total = 0;
+  struct pollfd pfd = {.fd = master, .events = POLLIN};
+
+  while (poll(&pfd, 1, quiet_ms) > 0) {
+    ssize_t n = read(master, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    if (screen.on)
+      screen_feed(buf, n);
+    total += n;
+  }
+  return total;
+}
+
+static void send_keys(const char *keys, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(master, keys, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("render_pty: write");
+      exit(1);
+    }
+    keys += n;
+    len -= n;
+  }
+}
+
+/* Send one key and return the bytes the shell wrote in answer.  */
+static size_t key_bytes(const char *key) {
+  send_keys(key, strlen(key));
+  return drain(100);
+}
+
+/* Finish whatever is on the line with Enter, paste "echo " and
+   `tail_len` x's, and put the cursor between "echo" and its argument.  */
+static void setup_line(size_t tail_len) {
+  char *line = malloc(tail_len + 16);
+  size_t len = 0;
+
+  send_keys("\r", 1);
+  drain(200);
+  memcpy(line, "\033[200~echo ", 11);
+  len = 11;
+  memset(line + len, 'x', tail_len);
+  len += tail_len;
+  memcpy(line + len, "\033[201~", 6);
+  len += 6;
+  send_keys(line, len);
+  drain(200);
+  free(line);
+
+  key_bytes("\033[H");
+  for (int i = 0; i < 4; i++)
+    key_bytes("\033[C");
+}
+
+static void expect_small(const char *what, size_t tail_len, size_t bytes) {
+  if (bytes == 0 || bytes > MAX_KEY_BYTES) {
+    fprintf(stderr, "FAIL: %s with %zu bytes after the cursor: wrote %zu\n",
+            what, tail_len, bytes);
+    failures++;
+  }
+}
+
+/* Typing, Backspace and Delete in the middle of the line; returns the
+   bytes the typed key cost so lines of different length can be
+   compared.  */
+static size_t check_mid_line(size_t tail_len) {
+  setup_line(tail_len);
+
+  size_t typed = 0;
+  for (int i = 0; i < 10; i++) {
+    size_t n = key_bytes("y");
+    expect_small("typed key", tail_len, n);
+    typed = n;
+  }
+  for (int i = 0; i < 5; i++)
+    expect_small("Backspace", tail_len, key_bytes("\177"));
+  for (int i = 0; i < 5; i++)
+    expect_small("Delete", tail_len, key_bytes("\033[3~"));
+  expect_small("Left", tail_len, key_bytes("\033[D"));
+  expect_small("Right", tail_len, key_bytes("\033[C"));
+  return typed;
+}
+
+/* The line as the test expects it to be, edited alongside the shell's.  */
+static char model[1024];
+static int model_len, model_cursor;
+
+static void model_insert(char c) {
+  memmove(model + model_cursor + 1, model + model_cursor,
+          model_len - model_cursor);
+  model[model_cursor++] = c;
+  model_len++;
+}
+
+static void model_delete(int at) {
+  memmove(model + at, model + at + 1, model_len - at - 1);
+  model_len--;
+}
+
+/* The model screen must show the prompt's `prompt` cells, the line
+   after them running on across rows, nothing after it, and the cursor
+   where the line's cursor is.  */
+static void expect_screen(const char *what, int prompt) {
+  int cells = NARROW_ROWS * NARROW_COLS;
+  int end = prompt + model_len;
+  for (int i = prompt; i < cells; i++) {
+    char want = i < end ? model[i - prompt] : ' ';
+    char got = screen.cells[i / NARROW_COLS][i % NARROW_COLS];
+    if (got != want) {
+      fprintf(stderr,
+              "FAIL: %s at %d columns: row %d column %d shows '%c', "
+              "not '%c'\n",
+              what, NARROW_COLS, i / NARROW_COLS, i % NARROW_COLS, got, want);
+      failures++;
+      return;
+    }
+  }
+
+  int at = screen.row * NARROW_COLS + screen.col;
+  if (at != prompt + model_cursor) {
+    fprintf(stderr,
+            "FAIL: %s at %d columns: cursor at cell %d, not %d\n", what,
+            NARROW_COLS, at, prompt + model_cursor);
+    failures++;
+  }
+}
+
+/* Edit a line that wraps over several rows of an 80-column terminal:
+   keys in the middle, where the rows below must move with the text,
+   and at the end.  */
+static void check_wrapped(size_t tail_len) {
+  struct winsize ws = {.ws_row = NARROW_ROWS, .ws_col = NARROW_COLS};
+  ioctl(master, TIOCSWINSZ, &ws);
+  setup_line(tail_len);
+
+  model_len = 0;
+  for (const char *p = "echo "; *p; p++)
+    model[model_len++] = *p;
+  memset(model + model_len, 'x', tail_len);
+  model_len += tail_len;
+  model_cursor = 4;
+
+  // Ctrl-L clears the screen and draws the prompt and line again, so
+  // the model screen can start from it
+  memset(&screen, 0, sizeof(screen));
+  screen_clear(0, 0, NARROW_ROWS);
+  screen.on = 1;
+  key_bytes("\014");
+
+  // The prompt is whatever comes before the line; the line ends in an x
+  int last = NARROW_ROWS * NARROW_COLS - 1;
+  while (last > 0 &&
+         screen.cells[last / NARROW_COLS][last % NARROW_COLS] == ' ')
+    last--;
+  int prompt = last + 1 - model_len;
+  expect_screen("redraw", prompt);
+
+  for (int i = 0; i < 10; i++) {
+    key_bytes("y");
+    model_insert('y');
+    expect_screen("typed key", prompt);
+  }
+  for (int i = 0; i < 5; i++) {
+    key_bytes("\177");
+    model_delete(--model_cursor);
+    expect_screen("Backspace", prompt);
+  }
+  for (int i = 0; i < 5; i++) {
+    key_bytes("\033[3~");
+    model_delete(model_cursor);
+    expect_screen("Delete", prompt);
+  }
+
+  key_bytes("\033[F");
+  model_cursor = model_len;
+  expect_screen("End", prompt);
+  // Across the edge of the last row and back
+  for (int i = 0; i < NARROW_COLS; i++) {
+    key_bytes("z");
+    model_insert('z');
+  }
+  expect_screen("typed at the end", prompt);
+  for (int i = 0; i < NARROW_COLS; i++) {
+    key_bytes("\177");
+    model_delete(--model_cursor);
+  }
+  expect_screen("Backspace at the end", prompt);
+
+  screen.on = 0;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+                        struct FTW *ftw) {
+  (void)st, (void)flag, (void)ftw;
+  return remove(path);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: render_pty path/to/mu\n");
+    return 2;
+  }
+
+  // A throwaway HOME so no config or history is touched
+  char home[] = "/tmp/mu-test-XXXXXX";
+  if (!mkdtemp(home)) {
+    perror("render_pty: mkdtemp");
+    return 1;
+  }
+
+  struct winsize ws = {.ws_row = 24, .ws_col = 4000};
+  pid_t pid = forkpty(&master, NULL, NULL, &ws);
+  if (pid < 0) {
+    perror("render_pty: forkpty");
+    return 1;
+  }
+  if (pid == 0) {
+    // The session leader can't move to a process group of its own, as
+    // the shell does at startup, so the shell runs one level down
+    pid_t shell = fork();
+    if (shell == 0) {
+      setenv("HOME", home, 1);
+      setenv("TERM", "xterm", 1);
+      execl(argv[1], argv[1], (char *)NULL);
+      perror(argv[1]);
+      _exit(127);
+    }
+    int status = 1;
+    if (shell > 0)
+      waitpid(shell, &status, 0);
+    _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+  }
+
+  drain(300);  // the first prompt
+
+  size_t short_key = check_mid_line(10);
+  size_t long_key = check_mid_line(600);
+  if (short_key != long_key) {
+    fprintf(stderr,
+            "FAIL: a typed key cost %zu bytes with 10 bytes after the cursor "
+            "but %zu with 600\n",
+            short_key, long_key);
+    failures++;
+  }
+  check_wrapped(600);
+
+  // Leave the way a user would: finish the line, then Ctrl-D
+  send_keys("\r", 1);
+  drain(200);
+  send_keys("\004", 1);
+  drain(200);
+  kill(pid, SIGHUP);
+  waitpid(pid, NULL, 0);
+  close(master);
+  nftw(home, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+
+  if (failures) {
+    fprintf(stderr, "render_pty: %d failures\n", failures);
+    return 1;
+  }
+  printf("render_pty: ok, %zu bytes per mid-line key\n", long_key);
+  return 0;
+}
@@ -0,0 +1,172 @@
+/* What scripts print, run through `mu -c` and as script files.
+
+   Each case is a script, the arguments it is given and the exact output
+   expected on stdout; the shell runs it both ways, since the two read
+   their input differently.
+   Usage: script_output path/to/mu  */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct script_case {
+  const char *name;
+  const char *script;
+  const char *expected;
+  const char *args[4]; /* $1 onwards, ending in NULL */
+};
+
+static const struct script_case cases[] = {
+    // Builtins that replace or end the shell fork as pipeline stages
+    {"exec stage", "exec /bin/echo hi | cat; echo after\n", "hi\nafter\n",
+     {NULL}},
+    {"exit stage", "exit 3 | cat\necho after $?\n", "after 0\n", {NULL}},
+    // Only a lastpipe last stage runs in the shell; a builtin before it
+    // is forked, so it can't block the shell on a full pipe
+    {"lastpipe", "set -o lastpipe\nhelp | cat | read x rest\necho \"[$x]\"\n",
+     "[mu]\n", {NULL}},
+    // wait finds a background child by pid, after it has exited too
+    {"wait pid", "sh -c 'exit 4' &\nsleep 0.2\nwait $!\necho $?\n", "4\n",
+     {NULL}},
+    // Finished background jobs are freed between commands, so their
+    // numbers are free again
+    {"jobs freed",
+     "sh -c 'exit 3' &\nsleep 0.2\nsh -c 'sleep 0.2; exit 5' &\nwait %1\n"
+     "echo $?\n",
+     "5\n", {NULL}},
+    // A substitution that writes a file finishes before the next one
+    // reads it
+    {"ordered substitutions",
+     "echo $(sleep 0.1; echo 1 >/tmp/mu-subst-$$) $(cat /tmp/mu-subst-$$)\n"
+     "rm /tmp/mu-subst-$$\n",
+     "1\n", {NULL}},
+    // Substitution drops only trailing newlines, never a carriage return
+    {"trailing CR", "printf '[%s]' $(printf 'a\\r\\n\\n')\n", "[a\r]", {NULL}},
+    // Script grammar: comments, newlines ending commands and
+    // backslash-newline joining words
+    {"comments", "echo a # not echoed\n# a line of its own\necho b\n",
+     "a\nb\n", {NULL}},
+    {"newline after )", "(echo a)\necho b\n", "a\nb\n", {NULL}},
+    {"backslash-newline", "echo a \\\n  b\n", "a b\n", {NULL}},
+    {"command after &", "true & echo x\n", "x\n", {NULL}},
+    // Both sides of a sequence run in the shell itself
+    {"sequence in shell", "cd /; pwd\n", "/\n", {NULL}},
+    // External commands are waited for, with the usual exit statuses
+    {"waits for command", "sh -c 'sleep 0.1; echo a'; echo b\n", "a\nb\n",
+     {NULL}},
+    {"exit status", "sh -c 'exit 5'; echo $?\n", "5\n", {NULL}},
+    {"killed by signal", "sh -c 'kill -TERM $$'; echo $?\n", "143\n", {NULL}},
+    {"not found", "/nonexistent/cmd; echo $?\n", "127\n", {NULL}},
+    // Positional parameters
+    {"positional", "echo $1 ${2} $#\necho \"$@\"\n", "x y 2\nx y\n",
+     {"x", "y"}},
+};
+
+#define NUM_CASES (int)(sizeof(cases) / sizeof(cases[0]))
+
+static int failures = 0;
+
+/* Run mu with argv and return what it wrote to stdout, NUL-terminated.
+   Only stdout is compared, so its errors are thrown away.  */
+static char *run(char *const argv[]) {
+  int fds[2];
+  if (pipe(fds) < 0) {
+    perror("script_output: pipe");
+    exit(1);
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("script_output: fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0)
+      dup2(null, STDERR_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execv(argv[0], argv);
+    perror(argv[0]);
+    _exit(127);
+  }
+  close(fds[1]);
+
+  size_t len = 0, cap = 256;
+  char *out = malloc(cap);
+  for (;;) {
+    if (len + 1 == cap)
+      out = realloc(out, cap *= 2);
+    ssize_t n = read(fds[0], out + len, cap - len - 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    len += n;
+  }
+  out[len] = '\0';
+  close(fds[0]);
+  waitpid(pid, NULL, 0);
+  return out;
+}
+
+static void expect(const struct script_case *c, const char *how,
+                   const char *got) {
+  if (strcmp(got, c->expected) != 0) {
+    fprintf(stderr, "FAIL: %s (%s)\n  expected: \"%s\"\n  got:      \"%s\"\n",
+            c->name, how, c->expected, got);
+    failures++;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: script_output path/to/mu\n");
+    return 2;
+  }
+
+  char path[] = "/tmp/mu-test-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("script_output: mkstemp");
+    return 1;
+  }
+  close(fd);
+
+  for (int i = 0; i < NUM_CASES; i++) {
+    const struct script_case *c = &cases[i];
+
+    // -c takes $0 before the arguments; a script file is its own $0
+    char *dash_c[8] = {argv[1], "-c", (char *)c->script, "script_output"};
+    char *file[6] = {argv[1], path};
+    for (int k = 0; c->args[k]; k++)
+      dash_c[4 + k] = file[2 + k] = (char *)c->args[k];
+
+    char *out = run(dash_c);
+    expect(c, "-c", out);
+    free(out);
+
+    FILE *f = fopen(path, "w");
+    if (!f || fputs(c->script, f) == EOF || fclose(f) == EOF) {
+      perror("script_output: writing script");
+      return 1;
+    }
+    out = run(file);
+    expect(c, "file", out);
+    free(out);
+  }
+  unlink(path);
+
+  if (failures) {
+    fprintf(stderr, "script_output: %d failures\n", failures);
+    return 1;
+  }
+  printf("script_output: ok, %d scripts\n", NUM_CASES);
+  return 0;
+}